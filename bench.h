@@ -0,0 +1,242 @@
+/*
+  Shared pieces of the parser benchmarks: a deterministic random generator for synthetic
+  corpora, a growable corpus buffer and repeated-run timing.
+
+  Every sample is reported as MB/s, records/s and cycles/byte. Cycles are read from the
+  time stamp counter where there is one, so they count reference cycles at the nominal
+  clock rather than core cycles.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "types.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAS_CYCLE_COUNTER 1
+#else
+#define BENCH_HAS_CYCLE_COUNTER 0
+#endif
+
+#define BENCH_MAX_SAMPLES 64
+#define BENCH_DEFAULT_CORPUS_SIZE (32 << 20)
+#define BENCH_DEFAULT_REPEAT_COUNT 5
+
+typedef struct
+{
+    u64 State;
+} bench_random;
+
+typedef struct
+{
+    u8 *Data;
+    s64 Size;
+    s64 Capacity;
+} bench_corpus;
+
+typedef struct
+{
+    double Seconds;
+    u64 Cycles;
+} bench_sample;
+
+typedef struct
+{
+    s32 SampleCount;
+    double Seconds[BENCH_MAX_SAMPLES];
+    u64 Cycles[BENCH_MAX_SAMPLES];
+    s64 Bytes;
+    s64 Records;
+} bench_stats;
+
+typedef struct
+{
+    s64 CorpusSize;
+    s32 RepeatCount;
+} bench_options;
+
+bench_options ParseBenchOptions(int ArgCount, char **Args);
+bench_random SeedBenchRandom(u64 Seed);
+u32 BenchRandom(bench_random *Random, u32 Range);
+void AppendBench(bench_corpus *Corpus, char *Chars);
+void AppendBenchBytes(bench_corpus *Corpus, u8 *Bytes, s64 Count);
+void AppendBenchNumber(bench_corpus *Corpus, u32 Number, s32 Digits);
+void FreeBenchCorpus(bench_corpus *Corpus);
+bench_sample BeginBenchSample(void);
+void EndBenchSample(bench_stats *Stats, bench_sample Sample, s64 Bytes, s64 Records);
+void PrintBenchStats(char *Name, bench_stats *Stats);
+
+/* NOTE: usage: <program> [corpus megabytes] [repeat count] */
+bench_options ParseBenchOptions(int ArgCount, char **Args)
+{
+    bench_options Options;
+    Options.CorpusSize = BENCH_DEFAULT_CORPUS_SIZE;
+    Options.RepeatCount = BENCH_DEFAULT_REPEAT_COUNT;
+    if(ArgCount > 1 && atoi(Args[1]) > 0)
+    {
+        Options.CorpusSize = (s64)atoi(Args[1]) << 20;
+    }
+    if(ArgCount > 2 && atoi(Args[2]) > 0)
+    {
+        Options.RepeatCount = atoi(Args[2]);
+    }
+    if(Options.RepeatCount > BENCH_MAX_SAMPLES)
+    {
+        Options.RepeatCount = BENCH_MAX_SAMPLES;
+    }
+    return Options;
+}
+
+bench_random SeedBenchRandom(u64 Seed)
+{
+    bench_random Random;
+    Random.State = Seed ? Seed : 0x9E3779B97F4A7C15ULL;
+    return Random;
+}
+
+/* NOTE: xorshift64*, returns a value in [0, Range) */
+u32 BenchRandom(bench_random *Random, u32 Range)
+{
+    u64 X = Random->State;
+    X ^= X >> 12;
+    X ^= X << 25;
+    X ^= X >> 27;
+    Random->State = X;
+    return Range ? (u32)(((X * 0x2545F4914F6CDD1DULL) >> 32) % Range) : 0;
+}
+
+void AppendBenchBytes(bench_corpus *Corpus, u8 *Bytes, s64 Count)
+{
+    if(Corpus->Size + Count > Corpus->Capacity)
+    {
+        s64 Capacity = Corpus->Capacity ? Corpus->Capacity : (1 << 20);
+        while(Corpus->Size + Count > Capacity)
+        {
+            Capacity *= 2;
+        }
+        Corpus->Data = realloc(Corpus->Data, Capacity);
+        if(!Corpus->Data)
+        {
+            printf("Out of memory generating corpus\n");
+            exit(1);
+        }
+        Corpus->Capacity = Capacity;
+    }
+    memcpy(Corpus->Data + Corpus->Size, Bytes, Count);
+    Corpus->Size += Count;
+}
+
+void AppendBench(bench_corpus *Corpus, char *Chars)
+{
+    AppendBenchBytes(Corpus, (u8 *)Chars, strlen(Chars));
+}
+
+/* NOTE: zero-padded to Digits */
+void AppendBenchNumber(bench_corpus *Corpus, u32 Number, s32 Digits)
+{
+    char Chars[16];
+    s32 I;
+    if(Digits > 10)
+    {
+        Digits = 10;
+    }
+    for(I = Digits - 1; I >= 0; --I)
+    {
+        Chars[I] = (char)('0' + Number % 10);
+        Number /= 10;
+    }
+    AppendBenchBytes(Corpus, (u8 *)Chars, Digits);
+}
+
+void FreeBenchCorpus(bench_corpus *Corpus)
+{
+    free(Corpus->Data);
+    Corpus->Data = 0;
+    Corpus->Size = 0;
+    Corpus->Capacity = 0;
+}
+
+static double BenchSeconds(void)
+{
+    struct timespec Time;
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return (double)Time.tv_sec + (double)Time.tv_nsec * 1e-9;
+}
+
+static u64 BenchCycles(void)
+{
+#if BENCH_HAS_CYCLE_COUNTER
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+bench_sample BeginBenchSample(void)
+{
+    bench_sample Sample;
+    Sample.Seconds = BenchSeconds();
+    Sample.Cycles = BenchCycles();
+    return Sample;
+}
+
+/* NOTE: Bytes and Records describe a single run and should be the same for every sample */
+void EndBenchSample(bench_stats *Stats, bench_sample Sample, s64 Bytes, s64 Records)
+{
+    u64 Cycles = BenchCycles();
+    double Seconds = BenchSeconds();
+    if(Stats->SampleCount < BENCH_MAX_SAMPLES)
+    {
+        Stats->Seconds[Stats->SampleCount] = Seconds - Sample.Seconds;
+        Stats->Cycles[Stats->SampleCount] = Cycles - Sample.Cycles;
+        ++Stats->SampleCount;
+    }
+    Stats->Bytes = Bytes;
+    Stats->Records = Records;
+}
+
+static int CompareBenchSeconds(const void *A, const void *B)
+{
+    double SecondsA = *(double *)A;
+    double SecondsB = *(double *)B;
+    return SecondsA < SecondsB ? -1 : SecondsA > SecondsB ? 1 : 0;
+}
+
+static int CompareBenchCycles(const void *A, const void *B)
+{
+    u64 CyclesA = *(u64 *)A;
+    u64 CyclesB = *(u64 *)B;
+    return CyclesA < CyclesB ? -1 : CyclesA > CyclesB ? 1 : 0;
+}
+
+/* NOTE: one line per benchmark, reporting the median and best sample */
+void PrintBenchStats(char *Name, bench_stats *Stats)
+{
+    double Seconds[BENCH_MAX_SAMPLES];
+    u64 Cycles[BENCH_MAX_SAMPLES];
+    double Median, Best, MegaBytes;
+    s32 Count = Stats->SampleCount;
+    if(Count == 0)
+    {
+        return;
+    }
+    memcpy(Seconds, Stats->Seconds, Count * sizeof(double));
+    memcpy(Cycles, Stats->Cycles, Count * sizeof(u64));
+    qsort(Seconds, Count, sizeof(double), CompareBenchSeconds);
+    qsort(Cycles, Count, sizeof(u64), CompareBenchCycles);
+    Median = Seconds[Count / 2];
+    Best = Seconds[0];
+    if(Median <= 0.0)
+    {
+        Median = Best = 1e-9;
+    }
+    MegaBytes = (double)Stats->Bytes / (1024.0 * 1024.0);
+    printf("%-28s %8.1f MB/s (best %8.1f) %12.0f records/s", Name, MegaBytes / Median,
+           MegaBytes / (Best > 0.0 ? Best : 1e-9), (double)Stats->Records / Median);
+    if(BENCH_HAS_CYCLE_COUNTER && Stats->Bytes > 0)
+    {
+        printf(" %7.2f cycles/byte", (double)Cycles[Count / 2] / (double)Stats->Bytes);
+    }
+    printf("  [%lld bytes, %lld records, %d runs]\n", (long long)Stats->Bytes,
+           (long long)Stats->Records, Count);
+}
@@ -0,0 +1,19 @@
+#!/usr/bin/env bash
+# usage: ./bench.sh [corpus megabytes] [repeat count]
+# INSTRUMENT=1 ./bench.sh builds with PARSER_INSTRUMENT; reports go to stderr or to
+# the file named by PARSER_INSTRUMENT_REPORT
+
+BENCH_FILES="parse_html_bench parse_ical_bench parse_aws_log_bench"
+LIBS="-pthread"
+SETTINGS="-std=c89 -O2 -Wall -Wextra -Wstrict-prototypes -Wold-style-definition -Wmissing-prototypes -Wmissing-declarations"
+if [ -n "$INSTRUMENT" ]; then
+    SETTINGS="$SETTINGS -DPARSER_INSTRUMENT"
+fi
+
+for BENCH in $BENCH_FILES; do
+    gcc $SETTINGS $BENCH.c -o $BENCH $LIBS || exit 1
+done
+
+for BENCH in $BENCH_FILES; do
+    ./$BENCH "$@" || exit 1
+done | tee bench_output.txt
@@ -4,6 +4,11 @@ DEBUG=1
 # SOURCE_FILES="parse_html.c"
 # SOURCE_FILES="parse_ical.c"
 SOURCE_FILES="parse_aws_log_test.c"
+# SOURCE_FILES="parse_html_bench.c"
+# SOURCE_FILES="parse_ical_bench.c"
+# SOURCE_FILES="parse_aws_log_bench.c"
+# SOURCE_FILES="scan_kernels_test.c"
+LIBS="-pthread"
 SETTINGS="-std=c89 -Wall -Wextra -Wstrict-prototypes -Wold-style-definition -Wmissing-prototypes -Wmissing-declarations"
 
 if [ $DEBUG -eq 0 ]; then
@@ -18,4 +23,4 @@ echo $TARGET
 echo $SETTINGS
 echo $SOURCE_FILES
 
-gcc $TARGET $SETTINGS $SOURCE_FILES
+gcc $TARGET $SETTINGS $SOURCE_FILES $LIBS
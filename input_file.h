@@ -0,0 +1,159 @@
+/*
+  Shared input layer for the parsers.
+
+  Regular files are memory-mapped so a parser reads the page cache directly instead of a
+  heap copy of the whole file, and sizes are 64-bit so inputs over 2GB work. Pipes,
+  terminals and anything else that cannot be mapped are read into a growing heap buffer.
+  Pass "-" to read standard input.
+
+  Data is exactly Size bytes with no terminator after it, so parsers must bound every read
+  by Size.
+*/
+#ifndef INPUT_FILE_H
+#define INPUT_FILE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "types.h"
+
+#define INPUT_FILE_READ_CHUNK_SIZE (1 << 16)
+
+typedef enum
+{
+    input_file_kind_None = 0,
+    input_file_kind_Mapped,
+    input_file_kind_Heap,
+} input_file_kind;
+
+typedef enum
+{
+    /* NOTE: the mapping is private, writes never reach the file */
+    input_file_flag_Writable = 1 << 0,
+    /* NOTE: only takes effect where the kernel backs file mappings with huge pages */
+    input_file_flag_HugePages = 1 << 1,
+} input_file_flag;
+
+typedef struct
+{
+    input_file_kind Kind;
+    s64 Size;
+    u8 *Data;
+} input_file;
+
+input_file OpenInputFile(char *FilePath, u32 Flags);
+void CloseInputFile(input_file *File);
+
+/* NOTE: Kind is input_file_kind_None when the read fails */
+static input_file ReadInputFileDescriptor(int Descriptor)
+{
+    input_file Result;
+    s64 Capacity = INPUT_FILE_READ_CHUNK_SIZE;
+    Result.Kind = input_file_kind_Heap;
+    Result.Size = 0;
+    Result.Data = malloc(Capacity);
+    while(Result.Data)
+    {
+        ssize_t ReadCount;
+        if(Result.Size == Capacity)
+        {
+            u8 *Data = realloc(Result.Data, Capacity * 2);
+            if(!Data)
+            {
+                break;
+            }
+            Result.Data = Data;
+            Capacity *= 2;
+        }
+        ReadCount = read(Descriptor, Result.Data + Result.Size, Capacity - Result.Size);
+        if(ReadCount == 0)
+        {
+            return Result;
+        }
+        if(ReadCount < 0)
+        {
+            break;
+        }
+        Result.Size += ReadCount;
+    }
+    free(Result.Data);
+    Result.Kind = input_file_kind_None;
+    Result.Size = 0;
+    Result.Data = 0;
+    return Result;
+}
+
+input_file OpenInputFile(char *FilePath, u32 Flags)
+{
+    input_file Result;
+    struct stat FileStat;
+    b32 IsStdin = strcmp(FilePath, "-") == 0;
+    int Descriptor = IsStdin ? STDIN_FILENO : open(FilePath, O_RDONLY);
+    memset(&Result, 0, sizeof(Result));
+    if(Descriptor < 0)
+    {
+        printf("Error opening file %s\n", FilePath);
+        return Result;
+    }
+    if(fstat(Descriptor, &FileStat) == 0 && S_ISREG(FileStat.st_mode) && FileStat.st_size > 0)
+    {
+        int Protection = PROT_READ;
+        void *Data;
+        if(Flags & input_file_flag_Writable)
+        {
+            Protection |= PROT_WRITE;
+        }
+        Data = mmap(0, FileStat.st_size, Protection, MAP_PRIVATE, Descriptor, 0);
+        if(Data != MAP_FAILED)
+        {
+            madvise(Data, FileStat.st_size, MADV_SEQUENTIAL);
+            madvise(Data, FileStat.st_size, MADV_WILLNEED);
+#ifdef MADV_HUGEPAGE
+            if(Flags & input_file_flag_HugePages)
+            {
+                madvise(Data, FileStat.st_size, MADV_HUGEPAGE);
+            }
+#endif
+            Result.Kind = input_file_kind_Mapped;
+            Result.Size = FileStat.st_size;
+            Result.Data = Data;
+        }
+    }
+    if(Result.Kind == input_file_kind_None)
+    {
+        Result = ReadInputFileDescriptor(Descriptor);
+        if(Result.Kind == input_file_kind_None)
+        {
+            printf("Error reading file %s\n", FilePath);
+        }
+    }
+    if(!IsStdin)
+    {
+        close(Descriptor);
+    }
+    return Result;
+}
+
+void CloseInputFile(input_file *File)
+{
+    switch(File->Kind)
+    {
+    case input_file_kind_Mapped:
+        munmap(File->Data, File->Size);
+        break;
+    case input_file_kind_Heap:
+        free(File->Data);
+        break;
+    default:
+        break;
+    }
+    File->Kind = input_file_kind_None;
+    File->Size = 0;
+    File->Data = 0;
+}
+
+#endif
@@ -0,0 +1,234 @@
+/*
+  Hot-path instrumentation for the parsers, compiled out unless PARSER_INSTRUMENT is defined.
+
+  - INSTRUMENT_COUNT bumps a counter, e.g. DFA state visits and transitions.
+  - INSTRUMENT_RULE_BEGIN/END bracket a grammar rule and record its calls and the bytes it
+    consumed, nested rules included.
+  - INSTRUMENT_PHASE_BEGIN/END bracket a parse phase and record wall time plus cycles,
+    instructions and branch misses from perf_event_open where the kernel allows it
+    (see /proc/sys/kernel/perf_event_paranoid); otherwise the counters are reported as null.
+
+  Counters are process-wide and not synchronized, so instrument single-threaded runs.
+  Reports are JSON, written to the file named by PARSER_INSTRUMENT_REPORT or to stderr.
+*/
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+#ifdef PARSER_INSTRUMENT
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "types.h"
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#define INSTRUMENT_MAX_RULE_DEPTH 64
+#define INSTRUMENT_HARDWARE_COUNTER_COUNT 3
+
+#define INSTRUMENT_COUNT(Counter) (++(Counter))
+#define INSTRUMENT_RULE_BEGIN(Rule, Position) InstrumentRuleBegin(&(Rule), (Position))
+#define INSTRUMENT_RULE_END(Rule, Position) InstrumentRuleEnd(&(Rule), (Position))
+#define INSTRUMENT_PHASE_BEGIN(Phase) BeginInstrumentPhase(&(Phase))
+#define INSTRUMENT_PHASE_END(Phase) EndInstrumentPhase(&(Phase))
+
+typedef struct
+{
+    u64 Calls;
+    u64 Bytes;
+} instrument_rule;
+
+/* NOTE: Counters holds cycles, instructions and branch misses, in that order */
+typedef struct
+{
+    char *Name;
+    u64 Runs;
+    double Seconds;
+    u64 Counters[INSTRUMENT_HARDWARE_COUNTER_COUNT];
+    double StartSeconds;
+    u64 StartCounters[INSTRUMENT_HARDWARE_COUNTER_COUNT];
+} instrument_phase;
+
+typedef struct
+{
+    b32 Initialized;
+    b32 HasHardwareCounters;
+    int GroupDescriptor;
+    s64 RuleStarts[INSTRUMENT_MAX_RULE_DEPTH];
+    s32 RuleDepth;
+} instrument_state;
+
+static instrument_state GlobalInstrument;
+
+void InstrumentRuleBegin(instrument_rule *Rule, s64 Position);
+void InstrumentRuleEnd(instrument_rule *Rule, s64 Position);
+void BeginInstrumentPhase(instrument_phase *Phase);
+void EndInstrumentPhase(instrument_phase *Phase);
+FILE *OpenInstrumentReport(void);
+void CloseInstrumentReport(FILE *Report);
+void WriteInstrumentPhases(FILE *Report, instrument_phase *Phases, s32 PhaseCount);
+
+void InstrumentRuleBegin(instrument_rule *Rule, s64 Position)
+{
+    ++Rule->Calls;
+    if(GlobalInstrument.RuleDepth < INSTRUMENT_MAX_RULE_DEPTH)
+    {
+        GlobalInstrument.RuleStarts[GlobalInstrument.RuleDepth] = Position;
+    }
+    ++GlobalInstrument.RuleDepth;
+}
+
+void InstrumentRuleEnd(instrument_rule *Rule, s64 Position)
+{
+    --GlobalInstrument.RuleDepth;
+    if(GlobalInstrument.RuleDepth < INSTRUMENT_MAX_RULE_DEPTH)
+    {
+        Rule->Bytes += Position - GlobalInstrument.RuleStarts[GlobalInstrument.RuleDepth];
+    }
+}
+
+#ifdef __linux__
+static int OpenPerfCounter(u32 Type, u64 Config, int GroupDescriptor)
+{
+    struct perf_event_attr Attributes;
+    memset(&Attributes, 0, sizeof(Attributes));
+    Attributes.size = sizeof(Attributes);
+    Attributes.type = Type;
+    Attributes.config = Config;
+    Attributes.exclude_kernel = 1;
+    Attributes.exclude_hv = 1;
+    Attributes.read_format = PERF_FORMAT_GROUP;
+    return (int)syscall(SYS_perf_event_open, &Attributes, 0, -1, GroupDescriptor, 0);
+}
+#endif
+
+/* NOTE: the counters run from the first phase on and phases read deltas, so phases can
+   nest */
+static void InitInstrument(void)
+{
+    GlobalInstrument.Initialized = 1;
+    GlobalInstrument.GroupDescriptor = -1;
+#ifdef __linux__
+    {
+        int Leader = OpenPerfCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1);
+        if(Leader >= 0)
+        {
+            int Instructions = OpenPerfCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, Leader);
+            int BranchMisses = OpenPerfCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, Leader);
+            if(Instructions >= 0 && BranchMisses >= 0)
+            {
+                GlobalInstrument.GroupDescriptor = Leader;
+                GlobalInstrument.HasHardwareCounters = 1;
+            }
+            else
+            {
+                if(Instructions >= 0) close(Instructions);
+                if(BranchMisses >= 0) close(BranchMisses);
+                close(Leader);
+            }
+        }
+    }
+#endif
+}
+
+static void ReadInstrumentCounters(u64 *Counters)
+{
+    memset(Counters, 0, INSTRUMENT_HARDWARE_COUNTER_COUNT * sizeof(u64));
+#ifdef __linux__
+    if(GlobalInstrument.HasHardwareCounters)
+    {
+        /* NOTE: PERF_FORMAT_GROUP reads the counter count followed by each value */
+        u64 Values[1 + INSTRUMENT_HARDWARE_COUNTER_COUNT];
+        if(read(GlobalInstrument.GroupDescriptor, Values, sizeof(Values)) == (ssize_t)sizeof(Values))
+        {
+            memcpy(Counters, Values + 1, INSTRUMENT_HARDWARE_COUNTER_COUNT * sizeof(u64));
+        }
+    }
+#endif
+}
+
+static double InstrumentSeconds(void)
+{
+    struct timespec Time;
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return (double)Time.tv_sec + (double)Time.tv_nsec * 1e-9;
+}
+
+void BeginInstrumentPhase(instrument_phase *Phase)
+{
+    if(!GlobalInstrument.Initialized)
+    {
+        InitInstrument();
+    }
+    ReadInstrumentCounters(Phase->StartCounters);
+    Phase->StartSeconds = InstrumentSeconds();
+}
+
+void EndInstrumentPhase(instrument_phase *Phase)
+{
+    u64 Counters[INSTRUMENT_HARDWARE_COUNTER_COUNT];
+    s32 I;
+    Phase->Seconds += InstrumentSeconds() - Phase->StartSeconds;
+    ReadInstrumentCounters(Counters);
+    for(I = 0; I < INSTRUMENT_HARDWARE_COUNTER_COUNT; ++I)
+    {
+        Phase->Counters[I] += Counters[I] - Phase->StartCounters[I];
+    }
+    ++Phase->Runs;
+}
+
+FILE *OpenInstrumentReport(void)
+{
+    char *Path = getenv("PARSER_INSTRUMENT_REPORT");
+    FILE *Report = Path ? fopen(Path, "w") : 0;
+    return Report ? Report : stderr;
+}
+
+void CloseInstrumentReport(FILE *Report)
+{
+    if(Report != stderr)
+    {
+        fclose(Report);
+    }
+}
+
+/* NOTE: writes the "phases" member of a report object */
+void WriteInstrumentPhases(FILE *Report, instrument_phase *Phases, s32 PhaseCount)
+{
+    s32 I;
+    fprintf(Report, "  \"phases\": [");
+    for(I = 0; I < PhaseCount; ++I)
+    {
+        instrument_phase *Phase = &Phases[I];
+        fprintf(Report, "%s\n    {\"name\": \"%s\", \"runs\": %llu, \"seconds\": %.9f", I ? "," : "",
+                Phase->Name, (unsigned long long)Phase->Runs, Phase->Seconds);
+        if(GlobalInstrument.HasHardwareCounters)
+        {
+            fprintf(Report, ", \"cycles\": %llu, \"instructions\": %llu, \"branch_misses\": %llu}",
+                    (unsigned long long)Phase->Counters[0], (unsigned long long)Phase->Counters[1],
+                    (unsigned long long)Phase->Counters[2]);
+        }
+        else
+        {
+            fprintf(Report, ", \"cycles\": null, \"instructions\": null, \"branch_misses\": null}");
+        }
+    }
+    fprintf(Report, "\n  ]");
+}
+
+#else
+
+#define INSTRUMENT_COUNT(Counter) ((void)0)
+#define INSTRUMENT_RULE_BEGIN(Rule, Position) ((void)0)
+#define INSTRUMENT_RULE_END(Rule, Position) ((void)0)
+#define INSTRUMENT_PHASE_BEGIN(Phase) ((void)0)
+#define INSTRUMENT_PHASE_END(Phase) ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,157 @@
+/*
+  Shared arena for parser output.
+
+  Allocations bump a pointer through large blocks and are never freed one by one. ResetArena
+  rewinds every block without releasing it, so a worker that resets between documents
+  stops allocating once its blocks cover the largest document it has seen. An arena is not
+  synchronized: give each thread its own.
+*/
+#ifndef MEMORY_ARENA_H
+#define MEMORY_ARENA_H
+
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+
+#define MEMORY_ARENA_DEFAULT_BLOCK_SIZE (1 << 20)
+#define MEMORY_ARENA_ALIGNMENT 16
+
+typedef struct memory_arena_block
+{
+    struct memory_arena_block *Next;
+    u8 *Base;
+    s64 Size;
+    s64 Used;
+} memory_arena_block;
+
+typedef struct
+{
+    memory_arena_block *First;
+    memory_arena_block *Current;
+    s64 MinimumBlockSize;
+
+    /* NOTE: statistics; Used is reset with the arena, the rest are kept */
+    s64 Used;
+    s64 HighWaterMark;
+    s64 ReservedSize;
+    s32 BlockCount;
+    s32 BlockAllocationCount;
+    s32 ResetCount;
+} memory_arena;
+
+#define PushStruct(Arena, type) ((type *)PushSize(Arena, sizeof(type)))
+#define PushArray(Arena, Count, type) ((type *)PushSize(Arena, (Count) * sizeof(type)))
+
+void InitArena(memory_arena *Arena, s64 MinimumBlockSize);
+void *PushSize(memory_arena *Arena, s64 Size);
+void *PushCopy(memory_arena *Arena, void *Source, s64 Size);
+void ResetArena(memory_arena *Arena);
+void FreeArena(memory_arena *Arena);
+
+void InitArena(memory_arena *Arena, s64 MinimumBlockSize)
+{
+    memset(Arena, 0, sizeof(*Arena));
+    Arena->MinimumBlockSize = MinimumBlockSize > 0 ? MinimumBlockSize : MEMORY_ARENA_DEFAULT_BLOCK_SIZE;
+}
+
+static memory_arena_block *AllocArenaBlock(memory_arena *Arena, s64 Size)
+{
+    memory_arena_block *Block;
+    if(Size < Arena->MinimumBlockSize)
+    {
+        Size = Arena->MinimumBlockSize;
+    }
+    /* NOTE: the header and the data share one allocation */
+    Block = malloc(sizeof(memory_arena_block) + MEMORY_ARENA_ALIGNMENT + Size);
+    if(!Block)
+    {
+        return 0;
+    }
+    Block->Next = 0;
+    Block->Base = (u8 *)Block + sizeof(memory_arena_block);
+    Block->Base += (MEMORY_ARENA_ALIGNMENT - ((size_t)Block->Base & (MEMORY_ARENA_ALIGNMENT - 1))) &
+        (MEMORY_ARENA_ALIGNMENT - 1);
+    Block->Size = Size;
+    Block->Used = 0;
+    Arena->ReservedSize += Size;
+    ++Arena->BlockCount;
+    ++Arena->BlockAllocationCount;
+    return Block;
+}
+
+/* NOTE: returns 0 only when a new block cannot be allocated */
+void *PushSize(memory_arena *Arena, s64 Size)
+{
+    memory_arena_block *Block = Arena->Current;
+    void *Result;
+    Size = (Size + MEMORY_ARENA_ALIGNMENT - 1) & ~(s64)(MEMORY_ARENA_ALIGNMENT - 1);
+    if(!Block || Block->Used + Size > Block->Size)
+    {
+        /* NOTE: after a reset, reuse the following blocks before allocating new ones.
+           A reused block that is too small for this push is skipped until the next reset. */
+        memory_arena_block *Next = Block ? Block->Next : Arena->First;
+        while(Next && Next->Size < Size)
+        {
+            Next = Next->Next;
+        }
+        if(!Next)
+        {
+            Next = AllocArenaBlock(Arena, Size);
+            if(!Next)
+            {
+                return 0;
+            }
+            if(Block)
+            {
+                Next->Next = Block->Next;
+                Block->Next = Next;
+            }
+            else
+            {
+                Next->Next = Arena->First;
+                Arena->First = Next;
+            }
+        }
+        Next->Used = 0;
+        Arena->Current = Block = Next;
+    }
+    Result = Block->Base + Block->Used;
+    Block->Used += Size;
+    Arena->Used += Size;
+    if(Arena->Used > Arena->HighWaterMark)
+    {
+        Arena->HighWaterMark = Arena->Used;
+    }
+    return Result;
+}
+
+void *PushCopy(memory_arena *Arena, void *Source, s64 Size)
+{
+    void *Result = PushSize(Arena, Size);
+    if(Result)
+    {
+        memcpy(Result, Source, Size);
+    }
+    return Result;
+}
+
+void ResetArena(memory_arena *Arena)
+{
+    Arena->Current = 0;
+    Arena->Used = 0;
+    ++Arena->ResetCount;
+}
+
+void FreeArena(memory_arena *Arena)
+{
+    memory_arena_block *Block = Arena->First;
+    while(Block)
+    {
+        memory_arena_block *Next = Block->Next;
+        free(Block);
+        Block = Next;
+    }
+    InitArena(Arena, Arena->MinimumBlockSize);
+}
+
+#endif
@@ -1,39 +1,94 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include "types.h"
+#include "input_file.h"
+#include "memory_arena.h"
+#include "scan_kernels.h"
 
-typedef int32_t s32;
+typedef struct
+{
+    s64 count;
+    s64 index;
+    u8 *data;
+} Buffer;
 
-typedef uint8_t u8;
+/*
+  S3 server access log fields, in line order.
+
+  https://docs.aws.amazon.com/AmazonS3/latest/userguide/LogFormat.html
+*/
+typedef enum
+{
+    aws_log_field_BucketOwner,
+    aws_log_field_Bucket,
+    aws_log_field_Time,
+    aws_log_field_RemoteIp,
+    aws_log_field_Requester,
+    aws_log_field_RequestId,
+    aws_log_field_Operation,
+    aws_log_field_Key,
+    aws_log_field_RequestUri,
+    aws_log_field_HttpStatus,
+    aws_log_field_ErrorCode,
+    aws_log_field_BytesSent,
+    aws_log_field_ObjectSize,
+    aws_log_field_TotalTime,
+    aws_log_field_TurnAroundTime,
+    aws_log_field_Referer,
+    aws_log_field_UserAgent,
+    aws_log_field_VersionId,
+    aws_log_field_HostId,
+    aws_log_field_SignatureVersion,
+    aws_log_field_CipherSuite,
+    aws_log_field_AuthenticationType,
+    aws_log_field_HostHeader,
+    aws_log_field_TlsVersion,
+    aws_log_field_AccessPointArn,
+    aws_log_field_AclRequired,
+    aws_log_field_Count,
+} aws_log_field;
+
+/* NOTE: older logs stop after the turn-around time, newer ones append fields */
+#define AWS_LOG_REQUIRED_FIELD_COUNT (aws_log_field_TurnAroundTime + 1)
+
+/* NOTE: lines longer than this are returned empty by next_aws_log_line, so every line,
+   field and String taken from one fits in an s32 even when the input is over 2GB */
+#define AWS_LOG_MAX_LINE_SIZE INT32_MAX
 
 typedef struct
 {
-    s32 count;
-    s32 index;
     u8 *data;
-} Buffer;
+    s32 count;
+} String;
 
-Buffer *read_file_into_buffer(char *file_path);
-void parse_aws_log(char *log_file_path);
+/* NOTE: fields point into the parsed line, brackets and quotes are stripped and "-" is
+   kept as is. Numeric fields that are "-" are 0. */
+typedef struct aws_log_record
+{
+    struct aws_log_record *next;
+    String fields[aws_log_field_Count];
+    s32 field_count;
+    s32 http_status;
+    s64 bytes_sent;
+    s64 object_size;
+    s32 total_time;
+    s32 turn_around_time;
+} aws_log_record;
 
-Buffer *read_file_into_buffer(char *file_path)
+typedef struct
 {
-    Buffer *buffer = 0;
-    FILE *file = fopen(file_path, "rb");
-    if (!file)
-    {
-        printf("Error opening file %s\n", file_path);
-        return buffer;
-    }
-    buffer = malloc(sizeof(Buffer));
-    fseek(file, 0, SEEK_END);
-    buffer->count = ftell(file);
-    buffer->data = malloc(buffer->count);
-    fseek(file, 0, SEEK_SET);
-    fread(buffer->data, 1, buffer->count, file);
-    fclose(file);
-    printf("file_size %d\n", buffer->count);
-    return buffer;
-}
+    aws_log_record *first;
+    aws_log_record *last;
+    s64 count;
+} aws_log_record_list;
+
+s32 next_aws_log_line(u8 *data, s64 count, s64 *offset, String *line);
+s32 next_aws_log_field(u8 *line, s32 count, s32 i, String *field);
+s32 parse_aws_log_line(u8 *line, s32 count, aws_log_record *record);
+s64 parse_aws_log_buffer(u8 *data, s64 count);
+aws_log_record_list parse_aws_log_records(memory_arena *arena, u8 *data, s64 count);
+s64 parse_aws_log(char *log_file_path);
 
 /*
   https://www.w3.org/TR/NOTE-datetime
@@ -65,15 +120,156 @@ static void parse_date_time(Buffer *buffer)
     /* TODO: implement */
 }
 
-void parse_aws_log(char *log_file_path)
+/* NOTE: returns 0 once offset reaches count. The line excludes the trailing "\n" and "\r".
+   A line longer than AWS_LOG_MAX_LINE_SIZE is skipped whole and comes back empty, so the
+   caller rejects it. */
+s32 next_aws_log_line(u8 *data, s64 count, s64 *offset, String *line)
 {
-    Buffer *buffer = read_file_into_buffer(log_file_path);
-    if (!buffer)
+    s64 line_start = *offset;
+    s64 line_size;
+    if (line_start >= count)
     {
-        return;
+        return 0;
     }
+    line_size = ScanKernels.FindByte(data + line_start, count - line_start, '\n');
+    *offset = line_start + line_size + 1;
+    line->data = data + line_start;
+    line->count = line_size > AWS_LOG_MAX_LINE_SIZE ? 0 : (s32)line_size;
+    if (line->count > 0 && line->data[line->count - 1] == '\r')
+    {
+        --line->count;
+    }
+    return 1;
+}
+
+static s64 parse_aws_log_number(String field)
+{
+    s64 result = 0;
     s32 i;
-    for (i = 0; i < buffer->count; ++i)
+    for (i = 0; i < field.count && field.data[i] >= '0' && field.data[i] <= '9'; ++i)
+    {
+        result = result * 10 + (field.data[i] - '0');
+    }
+    return result;
+}
+
+/* NOTE: reads the field starting at i and returns the start of the next one. count is a
+   line length from next_aws_log_line, so it is at most AWS_LOG_MAX_LINE_SIZE. */
+s32 next_aws_log_field(u8 *line, s32 count, s32 i, String *field)
+{
+    u8 terminator = ' ';
+    if (line[i] == '[')
+    {
+        terminator = ']';
+        ++i;
+    }
+    else if (line[i] == '"')
+    {
+        terminator = '"';
+        ++i;
+    }
+    field->data = line + i;
+    field->count = (s32)ScanKernels.FindByte(field->data, count - i, terminator);
+    i += field->count;
+    if (terminator != ' ' && i < count)
+    {
+        ++i;
+    }
+    while (i < count && line[i] == ' ')
+    {
+        ++i;
+    }
+    return i;
+}
+
+/* NOTE: returns 1 when the line holds at least AWS_LOG_REQUIRED_FIELD_COUNT fields */
+s32 parse_aws_log_line(u8 *line, s32 count, aws_log_record *record)
+{
+    s32 i = 0;
+    record->field_count = 0;
+    while (i < count && record->field_count < aws_log_field_Count)
+    {
+        i = next_aws_log_field(line, count, i, &record->fields[record->field_count]);
+        ++record->field_count;
+    }
+    if (record->field_count < AWS_LOG_REQUIRED_FIELD_COUNT)
+    {
+        return 0;
+    }
+    record->http_status = (s32)parse_aws_log_number(record->fields[aws_log_field_HttpStatus]);
+    record->bytes_sent = parse_aws_log_number(record->fields[aws_log_field_BytesSent]);
+    record->object_size = parse_aws_log_number(record->fields[aws_log_field_ObjectSize]);
+    record->total_time = (s32)parse_aws_log_number(record->fields[aws_log_field_TotalTime]);
+    record->turn_around_time = (s32)parse_aws_log_number(record->fields[aws_log_field_TurnAroundTime]);
+    return 1;
+}
+
+/* NOTE: parses log lines straight out of caller-owned memory, so batched readers can
+   hand over a slice of their arena without copying or allocating per file.
+   Returns the number of records parsed. */
+s64 parse_aws_log_buffer(u8 *data, s64 count)
+{
+    aws_log_record record;
+    String line;
+    s64 offset = 0;
+    s64 record_count = 0;
+    while (next_aws_log_line(data, count, &offset, &line))
+    {
+        record_count += parse_aws_log_line(line.data, line.count, &record);
+    }
+    return record_count;
+}
+
+/* NOTE: records are allocated from the arena and their fields point into data, so both
+   must outlive the list. */
+aws_log_record_list parse_aws_log_records(memory_arena *arena, u8 *data, s64 count)
+{
+    aws_log_record_list list;
+    aws_log_record *record = 0;
+    String line;
+    s64 offset = 0;
+    list.first = 0;
+    list.last = 0;
+    list.count = 0;
+    while (next_aws_log_line(data, count, &offset, &line))
+    {
+        if (!record)
+        {
+            record = PushStruct(arena, aws_log_record);
+            if (!record)
+            {
+                break;
+            }
+        }
+        if (parse_aws_log_line(line.data, line.count, record))
+        {
+            record->next = 0;
+            if (list.last)
+            {
+                list.last->next = record;
+            }
+            else
+            {
+                list.first = record;
+            }
+            list.last = record;
+            ++list.count;
+            record = 0;
+        }
+    }
+    return list;
+}
+
+/* NOTE: returns the number of records parsed, or -1 when the file could not be read */
+s64 parse_aws_log(char *log_file_path)
+{
+    s64 record_count;
+    input_file file = OpenInputFile(log_file_path, 0);
+    if (file.Kind == input_file_kind_None)
     {
+        return -1;
     }
+    record_count = parse_aws_log_buffer(file.Data, file.Size);
+    CloseInputFile(&file);
+    return record_count;
 }
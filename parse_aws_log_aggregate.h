@@ -0,0 +1,731 @@
+/*
+  Streaming group-by aggregation over parsed AWS log records.
+
+  Records are folded into aggregates as they are parsed and never materialized, so memory
+  grows with the number of groups rather than the number of lines:
+
+  - requests and bytes sent per status code, key prefix, client IP and operation, in
+    open-addressing hash tables
+  - p50/p99 style latency quantiles per operation, from log-bucketed histograms
+  - the most requested object keys, from a space-saving top-K sketch
+
+  Each thread aggregates into its own aws_log_aggregate and the partials are combined with
+  merge_aws_log_aggregate. Histograms and group tables merge exactly; the top-K sketch
+  stays an over-estimate after merging.
+
+  When filter is set, lines are matched against it on their raw bytes and only the lines
+  that pass are parsed; see parse_aws_log_filter.h, which must be included first.
+
+  When an allocation fails, out_of_memory is set and the aggregate stops taking records;
+  the totals then cover only the records counted before the failure.
+*/
+#include <string.h>
+#ifndef AWS_LOG_NO_THREADS
+#include <pthread.h>
+#endif
+
+#define AWS_LOG_GROUP_TABLE_INITIAL_CAPACITY 64
+#define AWS_LOG_KEY_ARENA_BLOCK_SIZE (64 << 10)
+#define AWS_LOG_HEAVY_HITTER_COUNT 32
+#define AWS_LOG_MAX_AGGREGATE_THREADS 16
+
+/* NOTE: latencies below 2^AWS_LOG_LATENCY_EXACT_BITS ms get their own bucket, larger ones
+   share a power of two split into 2^AWS_LOG_LATENCY_SUB_BUCKET_BITS buckets, which bounds
+   the relative error of a quantile to about 3%. */
+#define AWS_LOG_LATENCY_EXACT_BITS 6
+#define AWS_LOG_LATENCY_SUB_BUCKET_BITS 4
+#define AWS_LOG_LATENCY_SUB_BUCKET_COUNT (1 << AWS_LOG_LATENCY_SUB_BUCKET_BITS)
+#define AWS_LOG_LATENCY_BUCKET_COUNT ((1 << AWS_LOG_LATENCY_EXACT_BITS) + \
+                                      (31 - AWS_LOG_LATENCY_EXACT_BITS) * AWS_LOG_LATENCY_SUB_BUCKET_COUNT)
+
+typedef struct
+{
+    s64 count;
+    s64 buckets[AWS_LOG_LATENCY_BUCKET_COUNT];
+} aws_log_latency_sketch;
+
+/* NOTE: hash is 0 for empty slots */
+typedef struct
+{
+    u64 hash;
+    u8 *key;
+    s32 key_count;
+    s64 request_count;
+    s64 byte_count;
+    s32 latency_index;
+} aws_log_group;
+
+/* NOTE: keys are copied into key_arena since the parsed lines do not outlive the batch
+   they were read into. */
+typedef struct
+{
+    aws_log_group *groups;
+    s32 capacity;
+    s32 count;
+    memory_arena *key_arena;
+} aws_log_group_table;
+
+typedef struct
+{
+    u64 hash;
+    u8 *key;
+    s32 key_count;
+    s32 key_capacity;
+    s64 count;
+    s64 error;
+} aws_log_heavy_hitter;
+
+typedef struct
+{
+    aws_log_heavy_hitter hitters[AWS_LOG_HEAVY_HITTER_COUNT];
+    s32 count;
+} aws_log_heavy_hitter_sketch;
+
+typedef struct
+{
+    s64 record_count;
+    s64 rejected_count;
+    s64 filtered_count;
+    s32 out_of_memory;
+    aws_log_filter *filter;
+    s32 key_prefix_depth;
+    aws_log_group_table by_status;
+    aws_log_group_table by_key_prefix;
+    aws_log_group_table by_client_ip;
+    aws_log_group_table by_operation;
+    aws_log_latency_sketch *operation_latencies;
+    s32 operation_latency_count;
+    s32 operation_latency_capacity;
+    aws_log_heavy_hitter_sketch top_keys;
+    /* NOTE: the group tables point at key_arena, so an aggregate must not be copied */
+    memory_arena key_arena;
+} aws_log_aggregate;
+
+void init_aws_log_aggregate(aws_log_aggregate *aggregate, s32 key_prefix_depth);
+void free_aws_log_aggregate(aws_log_aggregate *aggregate);
+void add_aws_log_record(aws_log_aggregate *aggregate, aws_log_record *record);
+void aggregate_aws_log_buffer(aws_log_aggregate *aggregate, u8 *data, s64 count);
+void aggregate_aws_log_file(u8 *data, s32 count, void *user_data);
+void aggregate_aws_log_buffer_parallel(aws_log_aggregate *aggregate, u8 *data, s64 count,
+                                       s32 thread_count);
+void merge_aws_log_aggregate(aws_log_aggregate *dest, aws_log_aggregate *source);
+s32 aws_log_latency_quantile(aws_log_latency_sketch *sketch, double quantile);
+void print_aws_log_aggregate(aws_log_aggregate *aggregate, s32 row_limit);
+
+/* NOTE: FNV-1a, forced non-zero so 0 can mark an empty slot */
+static u64 hash_aws_log_key(u8 *key, s32 count)
+{
+    u64 hash = 14695981039346656037ULL;
+    s32 i;
+    for (i = 0; i < count; ++i)
+    {
+        hash ^= key[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash ? hash : 1;
+}
+
+static s32 init_aws_log_group_table(aws_log_group_table *table, memory_arena *key_arena)
+{
+    table->count = 0;
+    table->groups = calloc(AWS_LOG_GROUP_TABLE_INITIAL_CAPACITY, sizeof(aws_log_group));
+    table->capacity = table->groups ? AWS_LOG_GROUP_TABLE_INITIAL_CAPACITY : 0;
+    table->key_arena = key_arena;
+    return table->groups != 0;
+}
+
+static void free_aws_log_group_table(aws_log_group_table *table)
+{
+    free(table->groups);
+    table->groups = 0;
+}
+
+/* NOTE: returns 0, leaving the table as it was, when the larger table cannot be allocated */
+static s32 grow_aws_log_group_table(aws_log_group_table *table)
+{
+    aws_log_group *old_groups = table->groups;
+    s32 old_capacity = table->capacity;
+    s32 capacity = old_capacity ? old_capacity * 2 : AWS_LOG_GROUP_TABLE_INITIAL_CAPACITY;
+    aws_log_group *groups = calloc(capacity, sizeof(aws_log_group));
+    s32 i;
+    if (!groups)
+    {
+        return 0;
+    }
+    table->groups = groups;
+    table->capacity = capacity;
+    for (i = 0; i < old_capacity; ++i)
+    {
+        if (old_groups[i].hash)
+        {
+            s32 mask = table->capacity - 1;
+            s32 slot = (s32)(old_groups[i].hash & mask);
+            while (table->groups[slot].hash)
+            {
+                slot = (slot + 1) & mask;
+            }
+            table->groups[slot] = old_groups[i];
+        }
+    }
+    free(old_groups);
+    return 1;
+}
+
+/* NOTE: linear probing; the table is kept at most 3/4 full so probes stay short. Returns 0
+   when a new group is needed but the table or its key cannot be allocated. */
+static aws_log_group *find_aws_log_group(aws_log_group_table *table, u8 *key, s32 key_count)
+{
+    u64 hash = hash_aws_log_key(key, key_count);
+    s32 mask, slot;
+    aws_log_group *group;
+    u8 *group_key;
+    if ((table->count + 1) * 4 > table->capacity * 3 && !grow_aws_log_group_table(table))
+    {
+        return 0;
+    }
+    mask = table->capacity - 1;
+    slot = (s32)(hash & mask);
+    for (;;)
+    {
+        group = &table->groups[slot];
+        if (!group->hash)
+        {
+            break;
+        }
+        if (group->hash == hash && group->key_count == key_count &&
+            memcmp(group->key, key, key_count) == 0)
+        {
+            return group;
+        }
+        slot = (slot + 1) & mask;
+    }
+    group_key = PushCopy(table->key_arena, key, key_count);
+    if (!group_key)
+    {
+        return 0;
+    }
+    group->hash = hash;
+    group->key = group_key;
+    group->key_count = key_count;
+    group->request_count = 0;
+    group->byte_count = 0;
+    group->latency_index = -1;
+    ++table->count;
+    return group;
+}
+
+static s32 aws_log_latency_bucket(s32 latency)
+{
+    s32 exponent = AWS_LOG_LATENCY_EXACT_BITS;
+    s32 sub_bucket;
+    if (latency < (1 << AWS_LOG_LATENCY_EXACT_BITS))
+    {
+        return latency < 0 ? 0 : latency;
+    }
+    while (exponent < 30 && (latency >> (exponent + 1)))
+    {
+        ++exponent;
+    }
+    sub_bucket = (latency >> (exponent - AWS_LOG_LATENCY_SUB_BUCKET_BITS)) &
+        (AWS_LOG_LATENCY_SUB_BUCKET_COUNT - 1);
+    return (1 << AWS_LOG_LATENCY_EXACT_BITS) +
+        (exponent - AWS_LOG_LATENCY_EXACT_BITS) * AWS_LOG_LATENCY_SUB_BUCKET_COUNT + sub_bucket;
+}
+
+/* NOTE: returns the midpoint of the bucket */
+static s32 aws_log_latency_bucket_value(s32 bucket)
+{
+    s32 exponent, sub_bucket, shift;
+    if (bucket < (1 << AWS_LOG_LATENCY_EXACT_BITS))
+    {
+        return bucket;
+    }
+    bucket -= 1 << AWS_LOG_LATENCY_EXACT_BITS;
+    exponent = AWS_LOG_LATENCY_EXACT_BITS + bucket / AWS_LOG_LATENCY_SUB_BUCKET_COUNT;
+    sub_bucket = bucket % AWS_LOG_LATENCY_SUB_BUCKET_COUNT;
+    shift = exponent - AWS_LOG_LATENCY_SUB_BUCKET_BITS;
+    return ((AWS_LOG_LATENCY_SUB_BUCKET_COUNT + sub_bucket) << shift) + ((1 << shift) >> 1);
+}
+
+s32 aws_log_latency_quantile(aws_log_latency_sketch *sketch, double quantile)
+{
+    s64 rank = (s64)(quantile * (double)sketch->count + 0.5);
+    s64 seen = 0;
+    s32 i;
+    if (rank < 1)
+    {
+        rank = 1;
+    }
+    for (i = 0; i < AWS_LOG_LATENCY_BUCKET_COUNT; ++i)
+    {
+        seen += sketch->buckets[i];
+        if (seen >= rank)
+        {
+            return aws_log_latency_bucket_value(i);
+        }
+    }
+    return 0;
+}
+
+/* NOTE: returns -1 when the sketch array cannot grow */
+static s32 push_aws_log_latency_sketch(aws_log_aggregate *aggregate)
+{
+    if (aggregate->operation_latency_count == aggregate->operation_latency_capacity)
+    {
+        s32 capacity = aggregate->operation_latency_capacity ?
+            aggregate->operation_latency_capacity * 2 : 16;
+        aws_log_latency_sketch *latencies =
+            realloc(aggregate->operation_latencies, capacity * sizeof(aws_log_latency_sketch));
+        if (!latencies)
+        {
+            return -1;
+        }
+        aggregate->operation_latencies = latencies;
+        aggregate->operation_latency_capacity = capacity;
+    }
+    memset(&aggregate->operation_latencies[aggregate->operation_latency_count], 0,
+           sizeof(aws_log_latency_sketch));
+    return aggregate->operation_latency_count++;
+}
+
+/* NOTE: returns 0, leaving the hitter as it was, when the key cannot be allocated */
+static s32 set_aws_log_heavy_hitter_key(aws_log_heavy_hitter *hitter, u64 hash,
+                                        u8 *key, s32 key_count)
+{
+    if (key_count > hitter->key_capacity || !hitter->key)
+    {
+        u8 *hitter_key = malloc(key_count ? key_count : 1);
+        if (!hitter_key)
+        {
+            return 0;
+        }
+        free(hitter->key);
+        hitter->key = hitter_key;
+        hitter->key_capacity = key_count;
+    }
+    memcpy(hitter->key, key, key_count);
+    hitter->key_count = key_count;
+    hitter->hash = hash;
+    return 1;
+}
+
+/*
+  Space-saving: a key that is already tracked is counted, otherwise it takes the slot of
+  the least counted key and inherits its count as error. Any key whose true count exceeds
+  total / AWS_LOG_HEAVY_HITTER_COUNT is guaranteed to be tracked. Returns 0 when a key
+  cannot be stored.
+*/
+static s32 add_aws_log_heavy_hitter(aws_log_heavy_hitter_sketch *sketch, u8 *key, s32 key_count,
+                                     s64 count, s64 error)
+{
+    u64 hash = hash_aws_log_key(key, key_count);
+    aws_log_heavy_hitter *min_hitter;
+    s32 i;
+    for (i = 0; i < sketch->count; ++i)
+    {
+        aws_log_heavy_hitter *hitter = &sketch->hitters[i];
+        if (hitter->hash == hash && hitter->key_count == key_count &&
+            memcmp(hitter->key, key, key_count) == 0)
+        {
+            hitter->count += count;
+            hitter->error += error;
+            return 1;
+        }
+    }
+    if (sketch->count < AWS_LOG_HEAVY_HITTER_COUNT)
+    {
+        aws_log_heavy_hitter *hitter = &sketch->hitters[sketch->count];
+        if (!set_aws_log_heavy_hitter_key(hitter, hash, key, key_count))
+        {
+            return 0;
+        }
+        hitter->count = count;
+        hitter->error = error;
+        ++sketch->count;
+        return 1;
+    }
+    min_hitter = &sketch->hitters[0];
+    for (i = 1; i < sketch->count; ++i)
+    {
+        if (sketch->hitters[i].count < min_hitter->count)
+        {
+            min_hitter = &sketch->hitters[i];
+        }
+    }
+    if (!set_aws_log_heavy_hitter_key(min_hitter, hash, key, key_count))
+    {
+        return 0;
+    }
+    min_hitter->error = min_hitter->count + error;
+    min_hitter->count += count;
+    return 1;
+}
+
+void init_aws_log_aggregate(aws_log_aggregate *aggregate, s32 key_prefix_depth)
+{
+    memset(aggregate, 0, sizeof(*aggregate));
+    aggregate->key_prefix_depth = key_prefix_depth;
+    InitArena(&aggregate->key_arena, AWS_LOG_KEY_ARENA_BLOCK_SIZE);
+    if (!init_aws_log_group_table(&aggregate->by_status, &aggregate->key_arena) ||
+        !init_aws_log_group_table(&aggregate->by_key_prefix, &aggregate->key_arena) ||
+        !init_aws_log_group_table(&aggregate->by_client_ip, &aggregate->key_arena) ||
+        !init_aws_log_group_table(&aggregate->by_operation, &aggregate->key_arena))
+    {
+        aggregate->out_of_memory = 1;
+        return;
+    }
+    aggregate->operation_latencies = malloc(16 * sizeof(aws_log_latency_sketch));
+    if (!aggregate->operation_latencies)
+    {
+        aggregate->out_of_memory = 1;
+        return;
+    }
+    aggregate->operation_latency_capacity = 16;
+}
+
+void free_aws_log_aggregate(aws_log_aggregate *aggregate)
+{
+    s32 i;
+    free_aws_log_group_table(&aggregate->by_status);
+    free_aws_log_group_table(&aggregate->by_key_prefix);
+    free_aws_log_group_table(&aggregate->by_client_ip);
+    free_aws_log_group_table(&aggregate->by_operation);
+    FreeArena(&aggregate->key_arena);
+    free(aggregate->operation_latencies);
+    for (i = 0; i < aggregate->top_keys.count; ++i)
+    {
+        free(aggregate->top_keys.hitters[i].key);
+    }
+    memset(aggregate, 0, sizeof(*aggregate));
+}
+
+/* NOTE: the prefix runs up to and including the key_prefix_depth-th "/", or the last "/"
+   for shallower keys. Keys without a "/" are grouped under the empty prefix. */
+static String aws_log_key_prefix(String key, s32 depth)
+{
+    String prefix;
+    s32 slash_count = 0;
+    s32 i;
+    prefix.data = key.data;
+    prefix.count = 0;
+    if (key.count == 1 && key.data[0] == '-')
+    {
+        prefix.count = 1;
+        return prefix;
+    }
+    for (i = 0; i < key.count && slash_count < depth; ++i)
+    {
+        if (key.data[i] == '/')
+        {
+            ++slash_count;
+            prefix.count = i + 1;
+        }
+    }
+    return prefix;
+}
+
+static s32 add_aws_log_group(aws_log_group_table *table, String key, s64 byte_count)
+{
+    aws_log_group *group = find_aws_log_group(table, key.data, key.count);
+    if (!group)
+    {
+        return 0;
+    }
+    ++group->request_count;
+    group->byte_count += byte_count;
+    return 1;
+}
+
+/* NOTE: does nothing once the aggregate is out of memory. A record that runs out of memory
+   part way may already be in some of the group tables, but is not in record_count. */
+void add_aws_log_record(aws_log_aggregate *aggregate, aws_log_record *record)
+{
+    String key = record->fields[aws_log_field_Key];
+    String prefix = aws_log_key_prefix(key, aggregate->key_prefix_depth);
+    String operation = record->fields[aws_log_field_Operation];
+    aws_log_group *operation_group;
+    aws_log_latency_sketch *latency;
+
+    if (aggregate->out_of_memory ||
+        !add_aws_log_group(&aggregate->by_status, record->fields[aws_log_field_HttpStatus],
+                           record->bytes_sent) ||
+        !add_aws_log_group(&aggregate->by_key_prefix, prefix, record->bytes_sent) ||
+        !add_aws_log_group(&aggregate->by_client_ip, record->fields[aws_log_field_RemoteIp],
+                           record->bytes_sent))
+    {
+        aggregate->out_of_memory = 1;
+        return;
+    }
+
+    operation_group = find_aws_log_group(&aggregate->by_operation, operation.data, operation.count);
+    if (operation_group && operation_group->latency_index < 0)
+    {
+        operation_group->latency_index = push_aws_log_latency_sketch(aggregate);
+    }
+    if (!operation_group || operation_group->latency_index < 0)
+    {
+        aggregate->out_of_memory = 1;
+        return;
+    }
+    ++operation_group->request_count;
+    operation_group->byte_count += record->bytes_sent;
+    latency = &aggregate->operation_latencies[operation_group->latency_index];
+    ++latency->count;
+    ++latency->buckets[aws_log_latency_bucket(record->total_time)];
+
+    if (!add_aws_log_heavy_hitter(&aggregate->top_keys, key.data, key.count, 1, 0))
+    {
+        aggregate->out_of_memory = 1;
+        return;
+    }
+    ++aggregate->record_count;
+}
+
+void aggregate_aws_log_buffer(aws_log_aggregate *aggregate, u8 *data, s64 count)
+{
+    aws_log_record record;
+    String line;
+    s64 offset = 0;
+    while (!aggregate->out_of_memory && next_aws_log_line(data, count, &offset, &line))
+    {
+        if (aggregate->filter && !match_aws_log_filter(aggregate->filter, line.data, line.count))
+        {
+            ++aggregate->filtered_count;
+        }
+        else if (parse_aws_log_line(line.data, line.count, &record))
+        {
+            add_aws_log_record(aggregate, &record);
+        }
+        else if (line.count > 0)
+        {
+            ++aggregate->rejected_count;
+        }
+    }
+}
+
+/* NOTE: matches aws_log_file_callback so it can be handed to read_aws_log_dir */
+void aggregate_aws_log_file(u8 *data, s32 count, void *user_data)
+{
+    aggregate_aws_log_buffer(user_data, data, count);
+}
+
+static void merge_aws_log_group_table(aws_log_aggregate *dest, aws_log_group_table *dest_table,
+                                      aws_log_aggregate *source, aws_log_group_table *source_table)
+{
+    s32 i, j;
+    for (i = 0; !dest->out_of_memory && i < source_table->capacity; ++i)
+    {
+        aws_log_group *source_group = &source_table->groups[i];
+        aws_log_group *dest_group;
+        if (!source_group->hash)
+        {
+            continue;
+        }
+        dest_group = find_aws_log_group(dest_table,
+                                        source_group->key,
+                                        source_group->key_count);
+        if (!dest_group)
+        {
+            dest->out_of_memory = 1;
+            return;
+        }
+        dest_group->request_count += source_group->request_count;
+        dest_group->byte_count += source_group->byte_count;
+        if (source_group->latency_index >= 0)
+        {
+            aws_log_latency_sketch *source_latency =
+                &source->operation_latencies[source_group->latency_index];
+            aws_log_latency_sketch *dest_latency;
+            if (dest_group->latency_index < 0)
+            {
+                dest_group->latency_index = push_aws_log_latency_sketch(dest);
+                if (dest_group->latency_index < 0)
+                {
+                    dest->out_of_memory = 1;
+                    return;
+                }
+            }
+            dest_latency = &dest->operation_latencies[dest_group->latency_index];
+            dest_latency->count += source_latency->count;
+            for (j = 0; j < AWS_LOG_LATENCY_BUCKET_COUNT; ++j)
+            {
+                dest_latency->buckets[j] += source_latency->buckets[j];
+            }
+        }
+    }
+}
+
+void merge_aws_log_aggregate(aws_log_aggregate *dest, aws_log_aggregate *source)
+{
+    s32 i;
+    dest->record_count += source->record_count;
+    dest->rejected_count += source->rejected_count;
+    dest->filtered_count += source->filtered_count;
+    merge_aws_log_group_table(dest, &dest->by_status, source, &source->by_status);
+    merge_aws_log_group_table(dest, &dest->by_key_prefix, source, &source->by_key_prefix);
+    merge_aws_log_group_table(dest, &dest->by_client_ip, source, &source->by_client_ip);
+    merge_aws_log_group_table(dest, &dest->by_operation, source, &source->by_operation);
+    for (i = 0; i < source->top_keys.count; ++i)
+    {
+        aws_log_heavy_hitter *hitter = &source->top_keys.hitters[i];
+        if (!add_aws_log_heavy_hitter(&dest->top_keys, hitter->key, hitter->key_count,
+                                      hitter->count, hitter->error))
+        {
+            dest->out_of_memory = 1;
+        }
+    }
+    dest->out_of_memory |= source->out_of_memory;
+}
+
+typedef struct
+{
+    aws_log_aggregate aggregate;
+    u8 *data;
+    s64 count;
+} aws_log_aggregate_job;
+
+#ifndef AWS_LOG_NO_THREADS
+static void *aws_log_aggregate_thread(void *arg)
+{
+    aws_log_aggregate_job *job = arg;
+    aggregate_aws_log_buffer(&job->aggregate, job->data, job->count);
+    return 0;
+}
+#endif
+
+/* NOTE: splits the buffer on line boundaries, aggregates each part on its own thread
+   into a partial aggregate and merges the partials into aggregate. */
+void aggregate_aws_log_buffer_parallel(aws_log_aggregate *aggregate, u8 *data, s64 count,
+                                       s32 thread_count)
+{
+    aws_log_aggregate_job jobs[AWS_LOG_MAX_AGGREGATE_THREADS];
+#ifndef AWS_LOG_NO_THREADS
+    pthread_t threads[AWS_LOG_MAX_AGGREGATE_THREADS];
+    s32 started[AWS_LOG_MAX_AGGREGATE_THREADS];
+#endif
+    s64 offset = 0;
+    s32 i;
+    if (thread_count > AWS_LOG_MAX_AGGREGATE_THREADS)
+    {
+        thread_count = AWS_LOG_MAX_AGGREGATE_THREADS;
+    }
+    if (thread_count <= 1)
+    {
+        aggregate_aws_log_buffer(aggregate, data, count);
+        return;
+    }
+    for (i = 0; i < thread_count; ++i)
+    {
+        s64 end = count * (i + 1) / thread_count;
+        u8 *line_end;
+        if (end < offset)
+        {
+            end = offset;
+        }
+        line_end = end < count ? memchr(data + end, '\n', count - end) : 0;
+        end = line_end ? line_end - data + 1 : count;
+        init_aws_log_aggregate(&jobs[i].aggregate, aggregate->key_prefix_depth);
+        jobs[i].aggregate.filter = aggregate->filter;
+        jobs[i].data = data + offset;
+        jobs[i].count = end - offset;
+        offset = end;
+    }
+    for (i = 0; i < thread_count; ++i)
+    {
+#ifndef AWS_LOG_NO_THREADS
+        started[i] = pthread_create(&threads[i], 0, aws_log_aggregate_thread, &jobs[i]) == 0;
+        if (!started[i])
+#endif
+        {
+            aggregate_aws_log_buffer(&jobs[i].aggregate, jobs[i].data, jobs[i].count);
+        }
+    }
+    for (i = 0; i < thread_count; ++i)
+    {
+#ifndef AWS_LOG_NO_THREADS
+        if (started[i])
+        {
+            pthread_join(threads[i], 0);
+        }
+#endif
+        merge_aws_log_aggregate(aggregate, &jobs[i].aggregate);
+        free_aws_log_aggregate(&jobs[i].aggregate);
+    }
+}
+
+static int compare_aws_log_group_requests(const void *a, const void *b)
+{
+    s64 count_a = ((aws_log_group *)a)->request_count;
+    s64 count_b = ((aws_log_group *)b)->request_count;
+    return count_a < count_b ? 1 : count_a > count_b ? -1 : 0;
+}
+
+static void print_aws_log_group_table(aws_log_aggregate *aggregate, aws_log_group_table *table,
+                                      char *name, s32 row_limit)
+{
+    aws_log_group *groups = malloc(table->count * sizeof(aws_log_group) + 1);
+    s32 group_count = 0;
+    s32 i;
+    if (!groups)
+    {
+        printf("%s (%d groups, out of memory sorting them)\n", name, table->count);
+        return;
+    }
+    for (i = 0; i < table->capacity; ++i)
+    {
+        if (table->groups[i].hash)
+        {
+            groups[group_count++] = table->groups[i];
+        }
+    }
+    qsort(groups, group_count, sizeof(aws_log_group), compare_aws_log_group_requests);
+    printf("%s (%d groups)\n", name, group_count);
+    for (i = 0; i < group_count && i < row_limit; ++i)
+    {
+        aws_log_group *group = &groups[i];
+        printf("  %-40.*s requests %lld bytes %lld", group->key_count,
+               (char *)group->key,
+               (long long)group->request_count, (long long)group->byte_count);
+        if (group->latency_index >= 0)
+        {
+            aws_log_latency_sketch *latency = &aggregate->operation_latencies[group->latency_index];
+            printf(" p50 %dms p99 %dms", aws_log_latency_quantile(latency, 0.5),
+                   aws_log_latency_quantile(latency, 0.99));
+        }
+        printf("\n");
+    }
+    free(groups);
+}
+
+static int compare_aws_log_heavy_hitter_count(const void *a, const void *b)
+{
+    s64 count_a = ((aws_log_heavy_hitter *)a)->count;
+    s64 count_b = ((aws_log_heavy_hitter *)b)->count;
+    return count_a < count_b ? 1 : count_a > count_b ? -1 : 0;
+}
+
+void print_aws_log_aggregate(aws_log_aggregate *aggregate, s32 row_limit)
+{
+    aws_log_heavy_hitter hitters[AWS_LOG_HEAVY_HITTER_COUNT];
+    s32 i;
+    memcpy(hitters, aggregate->top_keys.hitters, sizeof(hitters));
+    qsort(hitters, aggregate->top_keys.count, sizeof(aws_log_heavy_hitter),
+          compare_aws_log_heavy_hitter_count);
+    printf("records %lld rejected %lld filtered %lld\n", (long long)aggregate->record_count,
+           (long long)aggregate->rejected_count, (long long)aggregate->filtered_count);
+    if (aggregate->out_of_memory)
+    {
+        printf("out of memory: only the records above were aggregated\n");
+    }
+    print_aws_log_group_table(aggregate, &aggregate->by_status, "status", row_limit);
+    print_aws_log_group_table(aggregate, &aggregate->by_operation, "operation", row_limit);
+    print_aws_log_group_table(aggregate, &aggregate->by_key_prefix, "key prefix", row_limit);
+    print_aws_log_group_table(aggregate, &aggregate->by_client_ip, "client ip", row_limit);
+    printf("top keys\n");
+    for (i = 0; i < aggregate->top_keys.count && i < row_limit; ++i)
+    {
+        aws_log_heavy_hitter *hitter = &hitters[i];
+        printf("  %-40.*s requests <= %lld (error %lld)\n", hitter->key_count, (char *)hitter->key,
+               (long long)hitter->count, (long long)hitter->error);
+    }
+}
@@ -0,0 +1,247 @@
+#define _GNU_SOURCE
+#include "parse_aws_log.h"
+#include "parse_aws_log_filter.h"
+#include "parse_aws_log_aggregate.h"
+#include "bench.h"
+
+#define ARRAY_COUNT(a) (sizeof(a) / sizeof(a[0]))
+
+static char *bench_buckets[] = {"logs-prod", "assets-prod", "backups", "static-site"};
+static char *bench_operations[] = {
+    "REST.GET.OBJECT", "REST.GET.OBJECT", "REST.GET.OBJECT", "REST.PUT.OBJECT",
+    "REST.HEAD.OBJECT", "REST.GET.BUCKET", "REST.DELETE.OBJECT", "REST.GET.ACL",
+};
+static char *bench_prefixes[] = {"images/", "css/", "js/", "uploads/2022/", "reports/daily/", ""};
+static char *bench_months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                               "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+static char *bench_user_agents[] = {
+    "Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/108.0",
+    "aws-cli/2.9.8 Python/3.9.11 Linux/5.15.0 exe/x86_64.ubuntu.22",
+    "S3Console/0.4",
+    "curl/7.81.0",
+};
+
+static s32 bench_status(bench_random *random)
+{
+    u32 roll = BenchRandom(random, 1000);
+    if (roll < 10)
+    {
+        return roll < 7 ? 503 : 500;
+    }
+    if (roll < 60)
+    {
+        return roll < 40 ? 404 : 403;
+    }
+    return roll < 100 ? 304 : 200;
+}
+
+static void append_bench_ip(bench_corpus *corpus, bench_random *random)
+{
+    /* NOTE: a skewed pool of client IPs so a few clients dominate */
+    u32 client = BenchRandom(random, 4) == 0 ? BenchRandom(random, 8) : BenchRandom(random, 5000);
+    u32 octet = (client >> 8) & 0xff;
+    AppendBench(corpus, "10.");
+    AppendBenchNumber(corpus, octet, octet >= 100 ? 3 : octet >= 10 ? 2 : 1);
+    AppendBench(corpus, ".");
+    AppendBenchNumber(corpus, client & 0xff, 3);
+    AppendBench(corpus, ".");
+    AppendBenchNumber(corpus, 1 + client % 250, 3);
+}
+
+static void append_bench_key(bench_corpus *corpus, bench_random *random)
+{
+    AppendBench(corpus, bench_prefixes[BenchRandom(random, ARRAY_COUNT(bench_prefixes))]);
+    AppendBench(corpus, "object-");
+    AppendBenchNumber(corpus, BenchRandom(random, 2) ? BenchRandom(random, 50) : BenchRandom(random, 100000), 6);
+    AppendBench(corpus, ".dat");
+}
+
+/*
+  S3 server access log, one line per request:
+  https://docs.aws.amazon.com/AmazonS3/latest/userguide/LogFormat.html
+*/
+static void generate_s3_log(bench_corpus *corpus, s64 size)
+{
+    bench_random random = SeedBenchRandom(1);
+    u32 second = 0;
+    while (corpus->Size < size)
+    {
+        char *bucket = bench_buckets[BenchRandom(&random, ARRAY_COUNT(bench_buckets))];
+        char *operation = bench_operations[BenchRandom(&random, ARRAY_COUNT(bench_operations))];
+        s32 status = bench_status(&random);
+        u32 bytes = status == 200 ? BenchRandom(&random, 1 << 20) : 0;
+        u32 total_time = 1 + BenchRandom(&random, 64) * BenchRandom(&random, 16);
+        second += BenchRandom(&random, 2);
+        AppendBench(corpus, "79a59df900b949e55d96a1e698fbacedfd6e09d98eacf8f8d5218e7cd47ef2be ");
+        AppendBench(corpus, bucket);
+        AppendBench(corpus, " [");
+        AppendBenchNumber(corpus, 1 + (second / 86400) % 28, 2);
+        AppendBench(corpus, "/");
+        AppendBench(corpus, bench_months[(second / (86400 * 28)) % 12]);
+        AppendBench(corpus, "/2022:");
+        AppendBenchNumber(corpus, (second / 3600) % 24, 2);
+        AppendBench(corpus, ":");
+        AppendBenchNumber(corpus, (second / 60) % 60, 2);
+        AppendBench(corpus, ":");
+        AppendBenchNumber(corpus, second % 60, 2);
+        AppendBench(corpus, " +0000] ");
+        append_bench_ip(corpus, &random);
+        AppendBench(corpus, " arn:aws:iam::123456789012:user/reader ");
+        AppendBenchNumber(corpus, BenchRandom(&random, 1u << 31), 16);
+        AppendBench(corpus, " ");
+        AppendBench(corpus, operation);
+        AppendBench(corpus, " ");
+        append_bench_key(corpus, &random);
+        AppendBench(corpus, " \"GET /");
+        AppendBench(corpus, bucket);
+        AppendBench(corpus, "/object HTTP/1.1\" ");
+        AppendBenchNumber(corpus, status, 3);
+        AppendBench(corpus, status >= 500 ? " InternalError " : " - ");
+        if (bytes)
+        {
+            AppendBenchNumber(corpus, bytes, 7);
+            AppendBench(corpus, " ");
+            AppendBenchNumber(corpus, bytes, 7);
+        }
+        else
+        {
+            AppendBench(corpus, "- -");
+        }
+        AppendBench(corpus, " ");
+        AppendBenchNumber(corpus, total_time, 4);
+        AppendBench(corpus, " ");
+        AppendBenchNumber(corpus, total_time / 2, 4);
+        AppendBench(corpus, " \"-\" \"");
+        AppendBench(corpus, bench_user_agents[BenchRandom(&random, ARRAY_COUNT(bench_user_agents))]);
+        AppendBench(corpus, "\" - s9lzHYrFp76ZVxRcpX9+5cjAnEH2ROuNkd2BHfIa6UkFVdtjf5mKR3/eTPFvsiP/XV/VLi31234= "
+                    "SigV4 ECDHE-RSA-AES128-GCM-SHA256 AuthHeader ");
+        AppendBench(corpus, bucket);
+        AppendBench(corpus, ".s3.us-west-2.amazonaws.com TLSv1.2 - -\n");
+    }
+}
+
+/*
+  Application Load Balancer access log:
+  https://docs.aws.amazon.com/elasticloadbalancing/latest/application/load-balancer-access-logs.html
+  parse_aws_log only knows the S3 layout, so ALB lines measure field splitting.
+*/
+static void generate_alb_log(bench_corpus *corpus, s64 size)
+{
+    bench_random random = SeedBenchRandom(2);
+    u32 second = 0;
+    while (corpus->Size < size)
+    {
+        s32 status = bench_status(&random);
+        second += BenchRandom(&random, 2);
+        AppendBench(corpus, "https 2022-07-");
+        AppendBenchNumber(corpus, 1 + (second / 86400) % 28, 2);
+        AppendBench(corpus, "T");
+        AppendBenchNumber(corpus, (second / 3600) % 24, 2);
+        AppendBench(corpus, ":");
+        AppendBenchNumber(corpus, (second / 60) % 60, 2);
+        AppendBench(corpus, ":");
+        AppendBenchNumber(corpus, second % 60, 2);
+        AppendBench(corpus, ".");
+        AppendBenchNumber(corpus, BenchRandom(&random, 1000000), 6);
+        AppendBench(corpus, "Z app/my-loadbalancer/50dc6c495c0c9188 ");
+        append_bench_ip(corpus, &random);
+        AppendBench(corpus, ":");
+        AppendBenchNumber(corpus, 1024 + BenchRandom(&random, 60000), 5);
+        AppendBench(corpus, " 10.0.0.1:80 0.000 0.");
+        AppendBenchNumber(corpus, BenchRandom(&random, 1000), 3);
+        AppendBench(corpus, " 0.000 ");
+        AppendBenchNumber(corpus, status, 3);
+        AppendBench(corpus, " ");
+        AppendBenchNumber(corpus, status, 3);
+        AppendBench(corpus, " ");
+        AppendBenchNumber(corpus, BenchRandom(&random, 4096), 4);
+        AppendBench(corpus, " ");
+        AppendBenchNumber(corpus, BenchRandom(&random, 1 << 20), 7);
+        AppendBench(corpus, " \"GET https://www.example.com:443/");
+        append_bench_key(corpus, &random);
+        AppendBench(corpus, " HTTP/1.1\" \"");
+        AppendBench(corpus, bench_user_agents[BenchRandom(&random, ARRAY_COUNT(bench_user_agents))]);
+        AppendBench(corpus, "\" ECDHE-RSA-AES128-GCM-SHA256 TLSv1.2 "
+                    "arn:aws:elasticloadbalancing:us-east-2:123456789012:targetgroup/my-targets/73e2d6bc24d8a067 "
+                    "\"Root=1-58337262-36d228ad5d99923122bbe354\" \"www.example.com\" "
+                    "\"arn:aws:acm:us-east-2:123456789012:certificate/12345678-1234-1234-1234-123456789012\" "
+                    "0 2022-07-02T22:22:48.364000Z \"forward\" \"-\" \"-\" \"10.0.0.1:80\" \"200\" \"-\" \"-\"\n");
+    }
+}
+
+static void run_split_bench(char *name, bench_corpus *corpus, bench_options options)
+{
+    bench_stats stats;
+    s32 run;
+    memset(&stats, 0, sizeof(stats));
+    for (run = 0; run < options.RepeatCount; ++run)
+    {
+        bench_sample sample = BeginBenchSample();
+        s64 record_count = parse_aws_log_buffer(corpus->Data, corpus->Size);
+        EndBenchSample(&stats, sample, corpus->Size, record_count);
+    }
+    PrintBenchStats(name, &stats);
+}
+
+static void run_records_bench(char *name, bench_corpus *corpus, bench_options options)
+{
+    bench_stats stats;
+    memory_arena arena;
+    s32 run;
+    memset(&stats, 0, sizeof(stats));
+    InitArena(&arena, 0);
+    for (run = 0; run < options.RepeatCount; ++run)
+    {
+        bench_sample sample;
+        aws_log_record_list records;
+        ResetArena(&arena);
+        sample = BeginBenchSample();
+        records = parse_aws_log_records(&arena, corpus->Data, corpus->Size);
+        EndBenchSample(&stats, sample, corpus->Size, records.count);
+    }
+    PrintBenchStats(name, &stats);
+    FreeArena(&arena);
+}
+
+static void run_aggregate_bench(char *name, bench_corpus *corpus, bench_options options,
+                                aws_log_filter *filter, s32 thread_count)
+{
+    bench_stats stats;
+    s32 run;
+    memset(&stats, 0, sizeof(stats));
+    for (run = 0; run < options.RepeatCount; ++run)
+    {
+        aws_log_aggregate aggregate;
+        bench_sample sample;
+        init_aws_log_aggregate(&aggregate, 1);
+        aggregate.filter = filter;
+        sample = BeginBenchSample();
+        aggregate_aws_log_buffer_parallel(&aggregate, corpus->Data, corpus->Size, thread_count);
+        EndBenchSample(&stats, sample, corpus->Size, aggregate.record_count + aggregate.filtered_count);
+        free_aws_log_aggregate(&aggregate);
+    }
+    PrintBenchStats(name, &stats);
+}
+
+int main(int arg_count, char **args)
+{
+    bench_options options = ParseBenchOptions(arg_count, args);
+    bench_corpus corpus;
+    aws_log_filter filter;
+
+    memset(&corpus, 0, sizeof(corpus));
+    generate_s3_log(&corpus, options.CorpusSize);
+    run_split_bench("s3 split", &corpus, options);
+    run_records_bench("s3 records", &corpus, options);
+    run_aggregate_bench("s3 aggregate", &corpus, options, 0, 1);
+    run_aggregate_bench("s3 aggregate 4 threads", &corpus, options, 0, 4);
+    memset(&filter, 0, sizeof(filter));
+    set_aws_log_filter_status_class(&filter, 5);
+    run_aggregate_bench("s3 aggregate 5xx", &corpus, options, &filter, 1);
+    FreeBenchCorpus(&corpus);
+
+    generate_alb_log(&corpus, options.CorpusSize);
+    run_split_bench("alb split", &corpus, options);
+    FreeBenchCorpus(&corpus);
+    return 0;
+}
@@ -0,0 +1,505 @@
+/*
+  Batched directory ingestion for S3 server access logs.
+
+  S3 drops tens of thousands of files of a few KB each, so the cost of reading a file
+  (open/fstat/read/close) outweighs parsing it. Files are read back to back into a batch
+  memory_arena that is reset and reused for every batch, and each file is handed to the
+  callback as a slice of that arena, with no per-file allocation. Reader threads prefetch
+  the next batches while the calling thread consumes the current one; with
+  AWS_LOG_NO_THREADS defined, or a reader count of zero, batches are filled synchronously
+  on the calling thread.
+*/
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifndef AWS_LOG_NO_THREADS
+#include <pthread.h>
+#endif
+
+/* NOTE: a batch ends once it holds this many bytes; a larger file gets a batch of its own */
+#define AWS_LOG_BATCH_SIZE (4 << 20)
+#define AWS_LOG_BATCH_MAX_FILES 2048
+#define AWS_LOG_MAX_READER_THREADS 8
+
+typedef void aws_log_file_callback(u8 *data, s32 count, void *user_data);
+
+typedef enum
+{
+    aws_log_batch_state_Free,
+    aws_log_batch_state_Filling,
+    aws_log_batch_state_Ready,
+} aws_log_batch_state;
+
+typedef struct
+{
+    u8 *data;
+    s32 count;
+} aws_log_batch_file;
+
+typedef struct
+{
+    aws_log_batch_state state;
+    memory_arena arena;
+    s64 byte_count;
+    s32 file_count;
+    aws_log_batch_file files[AWS_LOG_BATCH_MAX_FILES];
+} aws_log_batch;
+
+/* NOTE: a file that was opened but did not fit in the batch being filled; it is carried
+   into the next batch by the same reader. */
+typedef struct
+{
+    int fd;
+    s32 size;
+} aws_log_pending_file;
+
+typedef struct
+{
+    s32 file_count;
+    s32 error_count;
+    s32 batch_count;
+    s64 record_count;
+    s64 byte_count;
+} aws_log_dir_stats;
+
+typedef struct
+{
+    int dir_fd;
+    char *file_name_chars;
+    s32 *file_name_offsets;
+    s32 file_name_count;
+    s32 next_file_index;
+    s32 error_count;
+
+    aws_log_batch *batches;
+    s32 batch_count;
+#ifndef AWS_LOG_NO_THREADS
+    pthread_mutex_t mutex;
+    pthread_cond_t batch_freed;
+    pthread_cond_t batch_ready;
+    s32 active_reader_count;
+#endif
+} aws_log_dir_reader;
+
+aws_log_dir_stats read_aws_log_dir(char *dir_path, s32 reader_thread_count,
+                                   aws_log_file_callback *callback, void *user_data);
+aws_log_dir_stats parse_aws_log_dir(char *dir_path, s32 reader_thread_count);
+
+static void aws_log_dir_lock(aws_log_dir_reader *reader)
+{
+#ifndef AWS_LOG_NO_THREADS
+    pthread_mutex_lock(&reader->mutex);
+#else
+    (void)reader;
+#endif
+}
+
+static void aws_log_dir_unlock(aws_log_dir_reader *reader)
+{
+#ifndef AWS_LOG_NO_THREADS
+    pthread_mutex_unlock(&reader->mutex);
+#else
+    (void)reader;
+#endif
+}
+
+/* NOTE: the names are packed into one block so listing a large directory costs two
+   allocations instead of one per entry. */
+static s32 list_aws_log_dir(aws_log_dir_reader *reader, DIR *dir)
+{
+    struct dirent *entry;
+    s32 name_capacity = 1024;
+    s32 chars_capacity = 1024 * 64;
+    s32 chars_used = 0;
+    reader->file_name_offsets = malloc(name_capacity * sizeof(s32));
+    reader->file_name_chars = malloc(chars_capacity);
+    reader->file_name_count = 0;
+    while (reader->file_name_offsets && reader->file_name_chars &&
+           (entry = readdir(dir)) != 0)
+    {
+        s32 name_size = (s32)strlen(entry->d_name) + 1;
+        if (entry->d_name[0] == '.')
+        {
+            continue;
+        }
+        if (reader->file_name_count == name_capacity)
+        {
+            s32 *offsets = realloc(reader->file_name_offsets, name_capacity * 2 * sizeof(s32));
+            if (!offsets)
+            {
+                return 0;
+            }
+            reader->file_name_offsets = offsets;
+            name_capacity *= 2;
+        }
+        while (chars_used + name_size > chars_capacity)
+        {
+            char *chars = realloc(reader->file_name_chars, chars_capacity * 2);
+            if (!chars)
+            {
+                return 0;
+            }
+            reader->file_name_chars = chars;
+            chars_capacity *= 2;
+        }
+        memcpy(reader->file_name_chars + chars_used, entry->d_name, name_size);
+        reader->file_name_offsets[reader->file_name_count++] = chars_used;
+        chars_used += name_size;
+    }
+    return reader->file_name_offsets && reader->file_name_chars;
+}
+
+/* NOTE: returns 0 when every file has been claimed. Entries that are not regular files,
+   such as subdirectories, are skipped without counting an error; O_NONBLOCK keeps a FIFO
+   from blocking the open. */
+static s32 open_next_aws_log_file(aws_log_dir_reader *reader, aws_log_pending_file *file)
+{
+    for (;;)
+    {
+        struct stat file_stat;
+        s32 stat_ok;
+        s32 file_index;
+        char *file_name;
+        file->fd = -1;
+        aws_log_dir_lock(reader);
+        file_index = reader->next_file_index++;
+        aws_log_dir_unlock(reader);
+        if (file_index >= reader->file_name_count)
+        {
+            return 0;
+        }
+        file_name = reader->file_name_chars + reader->file_name_offsets[file_index];
+        file->fd = openat(reader->dir_fd, file_name, O_RDONLY | O_NONBLOCK);
+        if (file->fd < 0)
+        {
+            goto file_error;
+        }
+        stat_ok = fstat(file->fd, &file_stat) == 0;
+        if (stat_ok && S_ISREG(file_stat.st_mode) && file_stat.st_size <= INT32_MAX)
+        {
+            file->size = (s32)file_stat.st_size;
+            return 1;
+        }
+        close(file->fd);
+        file->fd = -1;
+        if (stat_ok && !S_ISREG(file_stat.st_mode))
+        {
+            continue;
+        }
+    file_error:
+        aws_log_dir_lock(reader);
+        ++reader->error_count;
+        aws_log_dir_unlock(reader);
+    }
+}
+
+static s32 read_aws_log_file_into_batch(aws_log_batch *batch, aws_log_pending_file *file)
+{
+    u8 *data = PushSize(&batch->arena, file->size);
+    s32 read_count = 0;
+    while (data && read_count < file->size)
+    {
+        ssize_t result = read(file->fd, data + read_count, file->size - read_count);
+        if (result <= 0)
+        {
+            break;
+        }
+        read_count += (s32)result;
+    }
+    close(file->fd);
+    if (!data || read_count != file->size)
+    {
+        return 0;
+    }
+    batch->files[batch->file_count].data = data;
+    batch->files[batch->file_count].count = read_count;
+    ++batch->file_count;
+    batch->byte_count += read_count;
+    return 1;
+}
+
+/* NOTE: fills the batch until it holds AWS_LOG_BATCH_SIZE bytes or the file table is
+   full. A file that does not fit is left in pending for the next batch. A batch only goes
+   over AWS_LOG_BATCH_SIZE when it holds a single larger file, whose block is released
+   here rather than kept by the reset, so batch memory stays bounded. */
+static void fill_aws_log_batch(aws_log_dir_reader *reader, aws_log_batch *batch,
+                               aws_log_pending_file *pending)
+{
+    if (batch->byte_count > AWS_LOG_BATCH_SIZE)
+    {
+        FreeArena(&batch->arena);
+    }
+    ResetArena(&batch->arena);
+    batch->byte_count = 0;
+    batch->file_count = 0;
+    for (;;)
+    {
+        if (pending->fd < 0 && !open_next_aws_log_file(reader, pending))
+        {
+            return;
+        }
+        if (batch->file_count > 0 &&
+            (batch->file_count == AWS_LOG_BATCH_MAX_FILES ||
+             batch->byte_count + pending->size > AWS_LOG_BATCH_SIZE))
+        {
+            return;
+        }
+        if (!read_aws_log_file_into_batch(batch, pending))
+        {
+            aws_log_dir_lock(reader);
+            ++reader->error_count;
+            aws_log_dir_unlock(reader);
+        }
+        pending->fd = -1;
+    }
+}
+
+static void consume_aws_log_batch(aws_log_batch *batch, aws_log_dir_stats *stats,
+                                  aws_log_file_callback *callback, void *user_data)
+{
+    s32 i;
+    for (i = 0; i < batch->file_count; ++i)
+    {
+        aws_log_batch_file file = batch->files[i];
+        callback(file.data, file.count, user_data);
+        stats->byte_count += file.count;
+    }
+    stats->file_count += batch->file_count;
+    ++stats->batch_count;
+}
+
+#ifndef AWS_LOG_NO_THREADS
+static void *aws_log_reader_thread(void *arg)
+{
+    aws_log_dir_reader *reader = arg;
+    aws_log_pending_file pending;
+    pending.fd = -1;
+    pending.size = 0;
+    for (;;)
+    {
+        aws_log_batch *batch = 0;
+        s32 i;
+        pthread_mutex_lock(&reader->mutex);
+        while (!batch)
+        {
+            for (i = 0; i < reader->batch_count; ++i)
+            {
+                if (reader->batches[i].state == aws_log_batch_state_Free)
+                {
+                    batch = &reader->batches[i];
+                    batch->state = aws_log_batch_state_Filling;
+                    break;
+                }
+            }
+            if (!batch)
+            {
+                pthread_cond_wait(&reader->batch_freed, &reader->mutex);
+            }
+        }
+        pthread_mutex_unlock(&reader->mutex);
+
+        fill_aws_log_batch(reader, batch, &pending);
+
+        pthread_mutex_lock(&reader->mutex);
+        if (batch->file_count > 0)
+        {
+            batch->state = aws_log_batch_state_Ready;
+        }
+        else
+        {
+            batch->state = aws_log_batch_state_Free;
+        }
+        if (batch->file_count == 0 && pending.fd < 0)
+        {
+            --reader->active_reader_count;
+            pthread_cond_broadcast(&reader->batch_ready);
+            pthread_mutex_unlock(&reader->mutex);
+            return 0;
+        }
+        pthread_cond_broadcast(&reader->batch_ready);
+        pthread_mutex_unlock(&reader->mutex);
+    }
+}
+
+/* NOTE: returns 0 when the readers could not be started so the caller can fall back to
+   synchronous reads. */
+static s32 read_aws_log_dir_threaded(aws_log_dir_reader *reader, s32 reader_thread_count,
+                                     aws_log_dir_stats *stats,
+                                     aws_log_file_callback *callback, void *user_data)
+{
+    pthread_t threads[AWS_LOG_MAX_READER_THREADS];
+    s32 thread_count = 0;
+    s32 i;
+    pthread_mutex_init(&reader->mutex, 0);
+    pthread_cond_init(&reader->batch_freed, 0);
+    pthread_cond_init(&reader->batch_ready, 0);
+    reader->active_reader_count = reader_thread_count;
+    for (i = 0; i < reader_thread_count; ++i)
+    {
+        if (pthread_create(&threads[i], 0, aws_log_reader_thread, reader) != 0)
+        {
+            break;
+        }
+        ++thread_count;
+    }
+    if (thread_count == 0)
+    {
+        pthread_cond_destroy(&reader->batch_ready);
+        pthread_cond_destroy(&reader->batch_freed);
+        pthread_mutex_destroy(&reader->mutex);
+        return 0;
+    }
+    pthread_mutex_lock(&reader->mutex);
+    reader->active_reader_count -= reader_thread_count - thread_count;
+    for (;;)
+    {
+        aws_log_batch *batch = 0;
+        for (i = 0; i < reader->batch_count; ++i)
+        {
+            if (reader->batches[i].state == aws_log_batch_state_Ready)
+            {
+                batch = &reader->batches[i];
+                break;
+            }
+        }
+        if (batch)
+        {
+            pthread_mutex_unlock(&reader->mutex);
+            consume_aws_log_batch(batch, stats, callback, user_data);
+            pthread_mutex_lock(&reader->mutex);
+            batch->state = aws_log_batch_state_Free;
+            pthread_cond_broadcast(&reader->batch_freed);
+        }
+        else if (reader->active_reader_count == 0)
+        {
+            break;
+        }
+        else
+        {
+            pthread_cond_wait(&reader->batch_ready, &reader->mutex);
+        }
+    }
+    pthread_mutex_unlock(&reader->mutex);
+    for (i = 0; i < thread_count; ++i)
+    {
+        pthread_join(threads[i], 0);
+    }
+    pthread_cond_destroy(&reader->batch_ready);
+    pthread_cond_destroy(&reader->batch_freed);
+    pthread_mutex_destroy(&reader->mutex);
+    return 1;
+}
+#endif
+
+static void read_aws_log_dir_sync(aws_log_dir_reader *reader, aws_log_dir_stats *stats,
+                                  aws_log_file_callback *callback, void *user_data)
+{
+    aws_log_pending_file pending;
+    aws_log_batch *batch = &reader->batches[0];
+    pending.fd = -1;
+    pending.size = 0;
+    for (;;)
+    {
+        fill_aws_log_batch(reader, batch, &pending);
+        if (batch->file_count == 0 && pending.fd < 0)
+        {
+            break;
+        }
+        consume_aws_log_batch(batch, stats, callback, user_data);
+    }
+}
+
+/*
+  Reads every regular file in dir_path and passes its contents to callback. The data
+  pointer is only valid for the duration of the callback. Files are visited in batch
+  order, which is not directory order once more than one reader thread is used.
+*/
+aws_log_dir_stats read_aws_log_dir(char *dir_path, s32 reader_thread_count,
+                                   aws_log_file_callback *callback, void *user_data)
+{
+    aws_log_dir_stats stats;
+    aws_log_dir_reader reader;
+    DIR *dir;
+    s32 i;
+    memset(&stats, 0, sizeof(stats));
+    memset(&reader, 0, sizeof(reader));
+    dir = opendir(dir_path);
+    if (!dir)
+    {
+        printf("Error opening directory %s\n", dir_path);
+        stats.error_count = 1;
+        return stats;
+    }
+    if (!list_aws_log_dir(&reader, dir))
+    {
+        printf("Error listing directory %s\n", dir_path);
+        free(reader.file_name_offsets);
+        free(reader.file_name_chars);
+        closedir(dir);
+        stats.error_count = 1;
+        return stats;
+    }
+    reader.dir_fd = dirfd(dir);
+
+#ifdef AWS_LOG_NO_THREADS
+    reader_thread_count = 0;
+#endif
+    if (reader_thread_count > AWS_LOG_MAX_READER_THREADS)
+    {
+        reader_thread_count = AWS_LOG_MAX_READER_THREADS;
+    }
+    if (reader_thread_count < 0)
+    {
+        reader_thread_count = 0;
+    }
+    /* NOTE: one batch per reader being filled plus one being consumed */
+    reader.batch_count = reader_thread_count + 1;
+    reader.batches = calloc(reader.batch_count, sizeof(aws_log_batch));
+    for (i = 0; reader.batches && i < reader.batch_count; ++i)
+    {
+        InitArena(&reader.batches[i].arena, AWS_LOG_BATCH_SIZE);
+    }
+
+    if (reader.batches)
+    {
+#ifndef AWS_LOG_NO_THREADS
+        if (reader_thread_count == 0 ||
+            !read_aws_log_dir_threaded(&reader, reader_thread_count, &stats, callback, user_data))
+#endif
+        {
+            read_aws_log_dir_sync(&reader, &stats, callback, user_data);
+        }
+        for (i = 0; i < reader.batch_count; ++i)
+        {
+            FreeArena(&reader.batches[i].arena);
+        }
+        free(reader.batches);
+    }
+    else
+    {
+        ++reader.error_count;
+    }
+    stats.error_count += reader.error_count;
+    free(reader.file_name_offsets);
+    free(reader.file_name_chars);
+    closedir(dir);
+    return stats;
+}
+
+static void parse_aws_log_dir_file(u8 *data, s32 count, void *user_data)
+{
+    aws_log_dir_stats *stats = user_data;
+    stats->record_count += parse_aws_log_buffer(data, count);
+}
+
+aws_log_dir_stats parse_aws_log_dir(char *dir_path, s32 reader_thread_count)
+{
+    aws_log_dir_stats record_stats;
+    aws_log_dir_stats stats;
+    memset(&record_stats, 0, sizeof(record_stats));
+    stats = read_aws_log_dir(dir_path, reader_thread_count, parse_aws_log_dir_file, &record_stats);
+    stats.record_count = record_stats.record_count;
+    return stats;
+}
@@ -0,0 +1,220 @@
+/*
+  Predicates evaluated against the raw bytes of an AWS log line.
+
+  Selective queries (a time window, 5xx responses, one bucket or key prefix) reject most
+  lines, so the filter is checked before parse_aws_log_line. Only the fields up to the last
+  one a predicate looks at are located, and each predicate is tested as soon as its field
+  is reached, so a rejected line usually costs a few ScanKernels.FindByte calls.
+  Timestamps are compared on their digits without converting the date.
+*/
+#include <string.h>
+
+/* NOTE: a zeroed filter accepts every line. Status bounds are inclusive, time bounds are
+   packed as YYYYMMDDhhmmss, see aws_log_time_key. */
+typedef struct
+{
+    String bucket;
+    String time_prefix;
+    s64 time_from;
+    s64 time_to;
+    String key_substring;
+    s32 status_min;
+    s32 status_max;
+} aws_log_filter;
+
+String aws_log_cstring(char *chars);
+void set_aws_log_filter_status_class(aws_log_filter *filter, s32 status_class);
+s64 aws_log_time_key(String time);
+s32 match_aws_log_filter(aws_log_filter *filter, u8 *line, s32 count);
+
+String aws_log_cstring(char *chars)
+{
+    String result;
+    result.data = (u8 *)chars;
+    result.count = (s32)strlen(chars);
+    return result;
+}
+
+/* NOTE: status_class 5 keeps 500-599 */
+void set_aws_log_filter_status_class(aws_log_filter *filter, s32 status_class)
+{
+    filter->status_min = status_class * 100;
+    filter->status_max = status_class * 100 + 99;
+}
+
+static s32 aws_log_is_digits(u8 *data, s32 count)
+{
+    s32 i;
+    for (i = 0; i < count; ++i)
+    {
+        if (data[i] < '0' || data[i] > '9')
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static s32 aws_log_digits(u8 *data, s32 count)
+{
+    s32 result = 0;
+    s32 i;
+    for (i = 0; i < count; ++i)
+    {
+        result = result * 10 + (data[i] - '0');
+    }
+    return result;
+}
+
+/*
+  Packs an S3 timestamp such as "06/Feb/2019:00:00:38 +0000" into 20190206000038 so that
+  timestamps compare as integers. S3 always logs in UTC, so the zone is ignored.
+  Returns 0 for malformed timestamps: a separator out of place, an unknown month or a
+  non-digit where a digit belongs.
+*/
+s64 aws_log_time_key(String time)
+{
+    static char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    s64 year, month, day, hour, minute, second;
+    u8 *data = time.data;
+    s32 i;
+    if (time.count < 20 || data[2] != '/' || data[6] != '/' || data[11] != ':' ||
+        data[14] != ':' || data[17] != ':' ||
+        !aws_log_is_digits(data, 2) || !aws_log_is_digits(data + 7, 4) ||
+        !aws_log_is_digits(data + 12, 2) || !aws_log_is_digits(data + 15, 2) ||
+        !aws_log_is_digits(data + 18, 2))
+    {
+        return 0;
+    }
+    month = 0;
+    for (i = 0; i < 12; ++i)
+    {
+        if (memcmp(months + i * 3, data + 3, 3) == 0)
+        {
+            month = i + 1;
+            break;
+        }
+    }
+    if (!month)
+    {
+        return 0;
+    }
+    day = aws_log_digits(data, 2);
+    year = aws_log_digits(data + 7, 4);
+    hour = aws_log_digits(data + 12, 2);
+    minute = aws_log_digits(data + 15, 2);
+    second = aws_log_digits(data + 18, 2);
+    return ((((year * 100 + month) * 100 + day) * 100 + hour) * 100 + minute) * 100 + second;
+}
+
+static s32 aws_log_contains(String haystack, String needle)
+{
+    u8 *at = haystack.data;
+    u8 *end = haystack.data + haystack.count;
+    if (needle.count == 0)
+    {
+        return 1;
+    }
+    while (end - at >= needle.count)
+    {
+        at = memchr(at, needle.data[0], (end - at) - needle.count + 1);
+        if (!at)
+        {
+            return 0;
+        }
+        if (memcmp(at, needle.data, needle.count) == 0)
+        {
+            return 1;
+        }
+        ++at;
+    }
+    return 0;
+}
+
+static s32 last_aws_log_filter_field(aws_log_filter *filter)
+{
+    if (filter->status_min || filter->status_max)
+    {
+        return aws_log_field_HttpStatus;
+    }
+    if (filter->key_substring.count)
+    {
+        return aws_log_field_Key;
+    }
+    if (filter->time_prefix.count || filter->time_from || filter->time_to)
+    {
+        return aws_log_field_Time;
+    }
+    if (filter->bucket.count)
+    {
+        return aws_log_field_Bucket;
+    }
+    return -1;
+}
+
+/* NOTE: returns 1 when the line passes every predicate of the filter */
+s32 match_aws_log_filter(aws_log_filter *filter, u8 *line, s32 count)
+{
+    s32 last_field = last_aws_log_filter_field(filter);
+    s32 field_index;
+    s32 i = 0;
+    String field;
+    for (field_index = 0; field_index <= last_field; ++field_index)
+    {
+        if (i >= count)
+        {
+            return 0;
+        }
+        i = next_aws_log_field(line, count, i, &field);
+        switch (field_index)
+        {
+        case aws_log_field_Bucket:
+            if (filter->bucket.count &&
+                (field.count != filter->bucket.count ||
+                 memcmp(field.data, filter->bucket.data, field.count) != 0))
+            {
+                return 0;
+            }
+            break;
+        case aws_log_field_Time:
+            if (filter->time_prefix.count &&
+                (field.count < filter->time_prefix.count ||
+                 memcmp(field.data, filter->time_prefix.data, filter->time_prefix.count) != 0))
+            {
+                return 0;
+            }
+            if (filter->time_from || filter->time_to)
+            {
+                s64 time_key = aws_log_time_key(field);
+                /* NOTE: a line whose time cannot be read is outside every window */
+                if (!time_key || time_key < filter->time_from || (filter->time_to && time_key > filter->time_to))
+                {
+                    return 0;
+                }
+            }
+            break;
+        case aws_log_field_Key:
+            if (!aws_log_contains(field, filter->key_substring))
+            {
+                return 0;
+            }
+            break;
+        case aws_log_field_HttpStatus:
+        {
+            s32 status;
+            if (field.count != 3 || !aws_log_is_digits(field.data, 3))
+            {
+                return 0;
+            }
+            status = aws_log_digits(field.data, 3);
+            if (status < filter->status_min || (filter->status_max && status > filter->status_max))
+            {
+                return 0;
+            }
+        } break;
+        default:
+            break;
+        }
+    }
+    return 1;
+}
@@ -1,7 +1,245 @@
+#define _GNU_SOURCE
 #include "parse_aws_log.h"
+#include "parse_aws_log_dir.h"
+#include "parse_aws_log_filter.h"
+#include "parse_aws_log_aggregate.h"
 
-int main()
+static char TEST_LOG[] =
+    "79a5 bucket1 [06/Feb/2019:00:00:38 +0000] 192.0.2.3 79a5 3E57 REST.GET.OBJECT photos/2019/a.jpg \"GET /bucket1/photos/2019/a.jpg HTTP/1.1\" 200 - 1000 1000 10 9 \"-\" \"S3Console/0.4\" - s9lz SigV4 ECDHE-RSA-AES128-GCM-SHA256 AuthHeader bucket1.s3.amazonaws.com TLSv1.2 - -\n"
+    "79a5 bucket1 [06/Feb/2019:00:00:39 +0000] 192.0.2.3 79a5 3E58 REST.GET.OBJECT photos/2019/b.jpg \"GET /bucket1/photos/2019/b.jpg HTTP/1.1\" 200 - 500 500 20 19 \"-\" \"S3Console/0.4\" - s9lz SigV4 ECDHE-RSA-AES128-GCM-SHA256 AuthHeader bucket1.s3.amazonaws.com TLSv1.2 - -\n"
+    "79a5 bucket1 [06/Feb/2019:00:00:40 +0000] 192.0.2.4 79a5 3E59 REST.PUT.OBJECT docs/c.txt \"PUT /bucket1/docs/c.txt HTTP/1.1\" 503 SlowDown - 12 200 - \"-\" \"aws-cli/2.0\" -\n"
+    "not a log line\n"
+    "79a5 bucket1 [06/Feb/2019:00:00:41 +0000] 192.0.2.3 79a5 3E5A REST.GET.OBJECT photos/2019/a.jpg \"GET /bucket1/photos/2019/a.jpg HTTP/1.1\" 200 - 1000 1000 30 29 \"-\" \"S3Console/0.4\" -\n";
+
+static char TEST_BAD_TIME_LOG[] =
+    "79a5 bucket1 [06/Xyz/2019:00:00:38 +0000] 192.0.2.3 79a5 3E57 REST.GET.OBJECT a.jpg \"GET /bucket1/a.jpg HTTP/1.1\" 200 - 1000 1000 10 9 \"-\" \"S3Console/0.4\" -\n"
+    "79a5 bucket1 [0a/Feb/2019:00:00:38 +0000] 192.0.2.3 79a5 3E58 REST.GET.OBJECT b.jpg \"GET /bucket1/b.jpg HTTP/1.1\" 200 - 1000 1000 10 9 \"-\" \"S3Console/0.4\" -\n"
+    "79a5 bucket1 [06/Feb/2019:00:00:38 +0000] 192.0.2.3 79a5 3E59 REST.GET.OBJECT c.jpg \"GET /bucket1/c.jpg HTTP/1.1\" 200 - 1000 1000 10 9 \"-\" \"S3Console/0.4\" -\n";
+
+static s32 expect_group(aws_log_group_table *table, char *key, s64 request_count, s64 byte_count)
+{
+    aws_log_group *group = find_aws_log_group(table, (u8 *)key, (s32)strlen(key));
+    if (group->request_count != request_count || group->byte_count != byte_count)
+    {
+        printf("group %s: requests %lld bytes %lld, expected %lld %lld\n", key,
+               (long long)group->request_count, (long long)group->byte_count,
+               (long long)request_count, (long long)byte_count);
+        return 0;
+    }
+    return 1;
+}
+
+static s32 test_aws_log_aggregate(void)
+{
+    aws_log_aggregate aggregate;
+    aws_log_group *get_group;
+    s32 ok = 1;
+    init_aws_log_aggregate(&aggregate, 1);
+    /* NOTE: four partial aggregates merged back together must match a single pass */
+    aggregate_aws_log_buffer_parallel(&aggregate, (u8 *)TEST_LOG, (s32)strlen(TEST_LOG), 4);
+    ok &= aggregate.record_count == 4 && aggregate.rejected_count == 1;
+    ok &= expect_group(&aggregate.by_status, "200", 3, 2500);
+    ok &= expect_group(&aggregate.by_status, "503", 1, 0);
+    ok &= expect_group(&aggregate.by_key_prefix, "photos/", 3, 2500);
+    ok &= expect_group(&aggregate.by_client_ip, "192.0.2.3", 3, 2500);
+    get_group = find_aws_log_group(&aggregate.by_operation, (u8 *)"REST.GET.OBJECT", 15);
+    ok &= get_group->request_count == 3;
+    ok &= aws_log_latency_quantile(&aggregate.operation_latencies[get_group->latency_index], 0.5) == 20;
+    ok &= aggregate.top_keys.count == 3;
+    printf("test_aws_log_aggregate %s\n", ok ? "passed" : "FAILED");
+    free_aws_log_aggregate(&aggregate);
+    return ok;
+}
+
+static s32 test_aws_log_records(void)
+{
+    memory_arena arena;
+    aws_log_record_list records;
+    s32 block_allocation_count;
+    s32 i;
+    s32 ok = 1;
+    InitArena(&arena, 1024);
+    /* NOTE: once the arena has grown, resetting it between documents must not allocate */
+    for (i = 0; i < 3; ++i)
+    {
+        ResetArena(&arena);
+        records = parse_aws_log_records(&arena, (u8 *)TEST_LOG, (s64)strlen(TEST_LOG));
+        ok &= records.count == 4 && records.last->http_status == 200;
+        ok &= records.first->next->next->http_status == 503;
+        if (i == 0)
+        {
+            block_allocation_count = arena.BlockAllocationCount;
+        }
+    }
+    ok &= arena.BlockAllocationCount == block_allocation_count && arena.HighWaterMark > 0;
+    printf("test_aws_log_records %s\n", ok ? "passed" : "FAILED");
+    FreeArena(&arena);
+    return ok;
+}
+
+static s32 test_aws_log_filter(void)
+{
+    aws_log_aggregate aggregate;
+    aws_log_filter filter;
+    String time;
+    s32 ok = 1;
+    s32 count = (s32)strlen(TEST_LOG);
+
+    memset(&filter, 0, sizeof(filter));
+    init_aws_log_aggregate(&aggregate, 1);
+    aggregate.filter = &filter;
+    set_aws_log_filter_status_class(&filter, 5);
+    aggregate_aws_log_buffer(&aggregate, (u8 *)TEST_LOG, count);
+    ok &= aggregate.record_count == 1 && aggregate.filtered_count == 4;
+    ok &= expect_group(&aggregate.by_status, "503", 1, 0);
+    free_aws_log_aggregate(&aggregate);
+
+    memset(&filter, 0, sizeof(filter));
+    init_aws_log_aggregate(&aggregate, 1);
+    aggregate.filter = &filter;
+    filter.bucket = aws_log_cstring("bucket1");
+    filter.key_substring = aws_log_cstring("2019/a");
+    filter.time_prefix = aws_log_cstring("06/Feb/2019:00");
+    aggregate_aws_log_buffer(&aggregate, (u8 *)TEST_LOG, count);
+    ok &= aggregate.record_count == 2;
+    free_aws_log_aggregate(&aggregate);
+
+    memset(&filter, 0, sizeof(filter));
+    init_aws_log_aggregate(&aggregate, 1);
+    aggregate.filter = &filter;
+    filter.time_from = 20190206000039LL;
+    filter.time_to = 20190206000040LL;
+    aggregate_aws_log_buffer(&aggregate, (u8 *)TEST_LOG, count);
+    ok &= aggregate.record_count == 2;
+    free_aws_log_aggregate(&aggregate);
+
+    /* NOTE: a malformed time must not slip through a window that only has an upper bound */
+    memset(&filter, 0, sizeof(filter));
+    init_aws_log_aggregate(&aggregate, 1);
+    aggregate.filter = &filter;
+    filter.time_to = 20190206000040LL;
+    aggregate_aws_log_buffer(&aggregate, (u8 *)TEST_BAD_TIME_LOG, (s32)strlen(TEST_BAD_TIME_LOG));
+    ok &= aggregate.record_count == 1 && aggregate.filtered_count == 2;
+    free_aws_log_aggregate(&aggregate);
+
+    time = aws_log_cstring("31/Dec/2020:23:59:58 +0000");
+    ok &= aws_log_time_key(time) == 20201231235958LL;
+    ok &= aws_log_time_key(aws_log_cstring("06/Xyz/2019:00:00:38 +0000")) == 0;
+    ok &= aws_log_time_key(aws_log_cstring("0a/Feb/2019:00:00:38 +0000")) == 0;
+    printf("test_aws_log_filter %s\n", ok ? "passed" : "FAILED");
+    return ok;
+}
+
+#define TEST_DIR_SMALL_FILE_COUNT 3000
+
+static s32 write_test_file(char *dir_path, char *name, s32 repeat_count)
+{
+    char path[256];
+    FILE *file;
+    s32 i;
+    s32 ok = 1;
+    snprintf(path, sizeof(path), "%s/%s", dir_path, name);
+    file = fopen(path, "wb");
+    if (!file)
+    {
+        return 0;
+    }
+    for (i = 0; i < repeat_count; ++i)
+    {
+        ok &= fputs(TEST_LOG, file) >= 0;
+    }
+    ok &= fclose(file) == 0;
+    return ok;
+}
+
+static void remove_test_dir(char *dir_path)
+{
+    char path[256];
+    DIR *dir = opendir(dir_path);
+    struct dirent *entry;
+    while (dir && (entry = readdir(dir)))
+    {
+        if (strcmp(entry->d_name, ".") && strcmp(entry->d_name, ".."))
+        {
+            snprintf(path, sizeof(path), "%s/%s", dir_path, entry->d_name);
+            if (unlink(path) != 0)
+            {
+                rmdir(path);
+            }
+        }
+    }
+    if (dir)
+    {
+        closedir(dir);
+    }
+    rmdir(dir_path);
+}
+
+/*
+  Enough small files to fill more than one batch by file count, one file larger than a
+  whole batch, an empty file and a subdirectory, which must be skipped without an error.
+  Every reader configuration must see the same files, bytes and records.
+*/
+static s32 test_aws_log_dir(void)
+{
+    char dir_path[] = "/tmp/aws_log_test_XXXXXX";
+    char name[64];
+    s32 thread_counts[] = {0, 1, 4};
+    s32 log_size = (s32)strlen(TEST_LOG);
+    s32 large_repeat_count = AWS_LOG_BATCH_SIZE / log_size + 16;
+    s32 i;
+    s32 ok = 1;
+    if (!mkdtemp(dir_path))
+    {
+        printf("test_aws_log_dir FAILED: cannot create %s\n", dir_path);
+        return 0;
+    }
+    for (i = 0; ok && i < TEST_DIR_SMALL_FILE_COUNT; ++i)
+    {
+        snprintf(name, sizeof(name), "small_%04d.log", i);
+        ok &= write_test_file(dir_path, name, 1);
+    }
+    ok &= write_test_file(dir_path, "large.log", large_repeat_count);
+    ok &= write_test_file(dir_path, "empty.log", 0);
+    snprintf(name, sizeof(name), "%s/subdir", dir_path);
+    ok &= mkdir(name, 0700) == 0;
+
+    for (i = 0; ok && i < (s32)(sizeof(thread_counts) / sizeof(thread_counts[0])); ++i)
+    {
+        s32 repeat_count = TEST_DIR_SMALL_FILE_COUNT + large_repeat_count;
+        aws_log_dir_stats stats = parse_aws_log_dir(dir_path, thread_counts[i]);
+        if (stats.file_count != TEST_DIR_SMALL_FILE_COUNT + 2 || stats.error_count != 0 ||
+            stats.byte_count != (s64)repeat_count * log_size ||
+            stats.record_count != (s64)repeat_count * 4)
+        {
+            printf("%d readers: files %d errors %d bytes %ld records %ld\n", thread_counts[i],
+                   stats.file_count, stats.error_count, (long)stats.byte_count,
+                   (long)stats.record_count);
+            ok = 0;
+        }
+    }
+    remove_test_dir(dir_path);
+    printf("test_aws_log_dir %s\n", ok ? "passed" : "FAILED");
+    return ok;
+}
+
+int main(int argc, char **argv)
 {
     char *log_file_path = "foo.txt";
+    if (argc > 1)
+    {
+        aws_log_aggregate aggregate;
+        aws_log_dir_stats stats;
+        init_aws_log_aggregate(&aggregate, 1);
+        stats = read_aws_log_dir(argv[1], 2, aggregate_aws_log_file, &aggregate);
+        printf("files %d bytes %ld batches %d errors %d\n", stats.file_count,
+               (long)stats.byte_count, stats.batch_count, stats.error_count);
+        print_aws_log_aggregate(&aggregate, 10);
+        stats.error_count += aggregate.out_of_memory;
+        free_aws_log_aggregate(&aggregate);
+        return stats.error_count != 0;
+    }
     parse_aws_log(log_file_path);
+    return !(test_aws_log_records() & test_aws_log_aggregate() & test_aws_log_filter() &
+             test_aws_log_dir());
 }
@@ -1,6 +1,14 @@
+#define _GNU_SOURCE
 #include "parse_html.h"
+#include "instrument.h"
+
+/* NOTE: the DFA prints every transition it takes; benchmarks build with this set to 0 */
+#ifndef PARSE_HTML_TRACE
+#define PARSE_HTML_TRACE 1
+#endif
 
 #define UTF8_ALPHABET_COUNT (1 << 8)
+#define HTML_MAX_SEQUENCE_COUNT 16
 s32 TRANSITION_TABLE[HTML_STATE_COUNT][UTF8_ALPHABET_COUNT];
 
 #define TAG_NAME_CHAR_COUNT 53
@@ -36,28 +44,7 @@ html_transition_entry Transitions[] = {
     {html_state_CommentBody,html_transition_kind_NotSequence,0,0,3,CommentTailSequence,html_state_Root},
 };
 
-static buffer *ReadFileIntoBuffer(char *FilePath)
-{
-    FILE *File = fopen(FilePath, "rb");
-    s32 FileSize;
-    buffer *Result;
-    u8 *Data;
-    if(!File)
-    {
-        return 0;
-    }
-    fseek(File, 0, SEEK_END);
-    FileSize = ftell(File);
-    Data = malloc(FileSize);
-    Result = malloc(sizeof(buffer));
-    Result->Count = FileSize;
-    Result->Data = Data;
-    fseek(File, 0, SEEK_SET);
-    fread(Result->Data, sizeof(*Result->Data), FileSize, File);
-    fclose(File);
-    return Result;
-}
-
+#if PARSE_HTML_TRACE || defined(PARSER_INSTRUMENT)
 static char *DebugPrintHtmlState(html_state State)
 {
     switch (State)
@@ -73,6 +60,52 @@ static char *DebugPrintHtmlState(html_state State)
     default: return "<generated-state>";
     }
 }
+#endif
+
+#ifdef PARSER_INSTRUMENT
+/* NOTE: Visits counts the bytes read in each state, Transitions[From][To] the moves between
+   them, self-loops included */
+typedef struct
+{
+    u64 Visits[HTML_STATE_COUNT];
+    u64 Transitions[HTML_STATE_COUNT][HTML_STATE_COUNT];
+    instrument_phase Populate;
+    instrument_phase Parse;
+} html_instrument;
+
+static html_instrument HtmlInstrument;
+
+static void WriteHtmlInstrumentReport(FILE *Report)
+{
+    instrument_phase Phases[2];
+    s32 From, To, Count = 0;
+    Phases[0] = HtmlInstrument.Populate;
+    Phases[0].Name = "populate";
+    Phases[1] = HtmlInstrument.Parse;
+    Phases[1].Name = "parse";
+    fprintf(Report, "{\n  \"parser\": \"html\",\n");
+    WriteInstrumentPhases(Report, Phases, ArrayCount(Phases));
+    fprintf(Report, ",\n  \"states\": [");
+    for (From = 0; From < HTML_STATE_COUNT; ++From)
+    {
+        fprintf(Report, "%s\n    {\"state\": %d, \"name\": \"%s\", \"visits\": %llu}", From ? "," : "",
+                From, DebugPrintHtmlState(From), (unsigned long long)HtmlInstrument.Visits[From]);
+    }
+    fprintf(Report, "\n  ],\n  \"transitions\": [");
+    for (From = 0; From < HTML_STATE_COUNT; ++From)
+    {
+        for (To = 0; To < HTML_STATE_COUNT; ++To)
+        {
+            if (HtmlInstrument.Transitions[From][To])
+            {
+                fprintf(Report, "%s\n    {\"from\": %d, \"to\": %d, \"count\": %llu}", Count++ ? "," : "",
+                        From, To, (unsigned long long)HtmlInstrument.Transitions[From][To]);
+            }
+        }
+    }
+    fprintf(Report, "\n  ]\n}\n");
+}
+#endif
 
 static void PopulateTransitionTable()
 {
@@ -80,6 +113,7 @@ static void PopulateTransitionTable()
     u8 C;
     u32 TransitionCount = ArrayCount(Transitions);
     s32 PreviousNextState, SequenceIndex = HTML_STATE_COUNT - 1;
+    INSTRUMENT_PHASE_BEGIN(HtmlInstrument.Populate);
     for (I = 0; I < TransitionCount; ++I)
     {
         html_transition_entry Transition = Transitions[I];
@@ -120,60 +154,175 @@ static void PopulateTransitionTable()
                     --SequenceIndex;
                 }
 
+#if PARSE_HTML_TRACE
                 printf("%s %c %s\n", DebugPrintHtmlState(CurrentState), Transition.Set[J], DebugPrintHtmlState(NextState));
+#endif
                 TRANSITION_TABLE[CurrentState][Transition.Set[J]] = NextState;
                 ++J;
             } while(J < Transition.Count);
             break;
         case html_transition_kind_NotSequence:
-            J = 0;
-            PreviousNextState = 0;
+        {
+            /* NOTE: a KMP automaton over the sequence. SequenceStates[J] has matched the first
+               J bytes, and a mismatch goes where the longest matched suffix that is also a
+               prefix of the sequence leads, so "--->" still ends a comment on "-->". */
+            s32 SequenceStates[HTML_MAX_SEQUENCE_COUNT + 1];
+            u32 Fallback = 0;
+            SequenceStates[0] = Transition.CurrentState;
+            for (J = 1; J < Transition.Count; ++J)
+            {
+                SequenceStates[J] = SequenceIndex--;
+            }
+            SequenceStates[Transition.Count] = Transition.NextState;
             for (K = 0; K < UTF8_ALPHABET_COUNT; ++K)
             {
-                TRANSITION_TABLE[Transition.CurrentState][K] = Transition.CurrentState;
+                TRANSITION_TABLE[SequenceStates[0]][K] = SequenceStates[0];
             }
-            do
+            TRANSITION_TABLE[SequenceStates[0]][Transition.Set[0]] = SequenceStates[1];
+            for (J = 1; J < Transition.Count; ++J)
             {
-                s32 NotFirst = J > 0;
-                s32 NotLast = J < Transition.Count;
-                s32 CurrentState = Transition.CurrentState;
-                if (NotFirst)
+                s32 FallbackNextState = TRANSITION_TABLE[SequenceStates[Fallback]][Transition.Set[J]];
+                for (K = 0; K < UTF8_ALPHABET_COUNT; ++K)
                 {
-                    CurrentState = PreviousNextState;
-                }
-                s32 NextState = Transition.NextState;
-                if (NotLast)
-                {
-                    NextState = SequenceIndex;
-                    PreviousNextState = NextState;
-                    --SequenceIndex;
+                    TRANSITION_TABLE[SequenceStates[J]][K] = TRANSITION_TABLE[SequenceStates[Fallback]][K];
                 }
-                TRANSITION_TABLE[CurrentState][Transition.Set[J]] = NextState;
-                ++J;
-            } while(J >= 0 && J < Transition.Count);
-            break;
+                TRANSITION_TABLE[SequenceStates[J]][Transition.Set[J]] = SequenceStates[J + 1];
+                for (Fallback = 0; SequenceStates[Fallback] != FallbackNextState; ++Fallback);
+            }
+        } break;
         }
     }
+#if PARSE_HTML_TRACE
     printf("SequenceIndex %d\n", SequenceIndex);
+#endif
+    INSTRUMENT_PHASE_END(HtmlInstrument.Populate);
 }
 
-s32 main()
+/* NOTE: returns the tokens in input order */
+static html_token *ParseHtml(buffer *Buffer, memory_arena *Arena)
 {
-    s32 I, Result = 0;
-    buffer *Buffer = ReadFileIntoBuffer("__test.html");
+    s64 I;
     html_state State = html_state_Root;
-    PopulateTransitionTable();
+    html_state NextState;
+    html_token *FirstToken = 0;
+    html_token *Token = 0;
+    INSTRUMENT_PHASE_BEGIN(HtmlInstrument.Parse);
     for (I = 0; I < Buffer->Count; ++I)
     {
-        State = TRANSITION_TABLE[State][Buffer->Data[I]];
+        NextState = TRANSITION_TABLE[State][Buffer->Data[I]];
+        INSTRUMENT_COUNT(HtmlInstrument.Visits[State]);
+        INSTRUMENT_COUNT(HtmlInstrument.Transitions[State][NextState]);
+        State = NextState;
+#if PARSE_HTML_TRACE
         printf("%s %c\n", DebugPrintHtmlState(State), Buffer->Data[I]);
+#endif
+        if (Token && Token->State == (s32)State)
+        {
+            ++Token->Count;
+        }
+        else
+        {
+            html_token *NextToken = PushStruct(Arena, html_token);
+            if (!NextToken)
+            {
+                /* NOTE: out of memory, return the tokens so far */
+                break;
+            }
+            NextToken->Next = 0;
+            NextToken->State = State;
+            NextToken->Offset = I;
+            NextToken->Count = 1;
+            if (Token)
+            {
+                Token->Next = NextToken;
+            }
+            else
+            {
+                FirstToken = NextToken;
+            }
+            Token = NextToken;
+        }
         if (State == html_state_Success || State == html_state_Error)
         {
             break;
         }
     }
-    free(Buffer->Data);
-    free(Buffer);
+    INSTRUMENT_PHASE_END(HtmlInstrument.Parse);
+    return FirstToken;
+}
+
+#ifndef PARSE_HTML_NO_MAIN
+/* NOTE: each input must end back in html_state_Root, i.e. the comment closes on its last byte */
+static s32 TestHtmlComments(void)
+{
+    static char *Inputs[] = {
+        "<!-- a -->",
+        "<!-- a --->",
+        "<!-- a - -->",
+        "<!-- a -- b -->",
+        "<!----->",
+    };
+    s32 I, Ok = 1;
+    memory_arena Arena;
+    InitArena(&Arena, 0);
+    for (I = 0; I < (s32)ArrayCount(Inputs); ++I)
+    {
+        buffer Buffer;
+        html_token *Token, *LastToken = 0;
+        Buffer.Count = strlen(Inputs[I]);
+        Buffer.Data = (u8 *)Inputs[I];
+        ResetArena(&Arena);
+        for (Token = ParseHtml(&Buffer, &Arena); Token; Token = Token->Next)
+        {
+            LastToken = Token;
+        }
+        if (!LastToken || LastToken->State != html_state_Root ||
+            LastToken->Offset + LastToken->Count != Buffer.Count)
+        {
+            printf("TestHtmlComments: \"%s\" did not close\n", Inputs[I]);
+            Ok = 0;
+        }
+    }
+    FreeArena(&Arena);
+    printf("TestHtmlComments %s\n", Ok ? "passed" : "FAILED");
+    return Ok;
+}
+
+s32 main()
+{
+    s32 Result = 0;
+    s64 TokenCount = 0;
+    input_file File = OpenInputFile("__test.html", 0);
+    buffer Buffer;
+    memory_arena Arena;
+    html_token *Token;
+    if (File.Kind == input_file_kind_None)
+    {
+        return 1;
+    }
+    Buffer.Count = File.Size;
+    Buffer.Data = File.Data;
+    InitArena(&Arena, 0);
+    PopulateTransitionTable();
+    if (!TestHtmlComments())
+    {
+        Result = 1;
+    }
+    for (Token = ParseHtml(&Buffer, &Arena); Token; Token = Token->Next)
+    {
+        ++TokenCount;
+    }
+    printf("TokenCount %ld ArenaHighWaterMark %ld\n", (long)TokenCount, (long)Arena.HighWaterMark);
+    FreeArena(&Arena);
+    CloseInputFile(&File);
     printf("sizeof(TRANSITION_TABLE) %lu\n", sizeof(TRANSITION_TABLE));
+#ifdef PARSER_INSTRUMENT
+    {
+        FILE *Report = OpenInstrumentReport();
+        WriteHtmlInstrumentReport(Report);
+        CloseInstrumentReport(Report);
+    }
+#endif
     return Result;
 }
+#endif
@@ -1,17 +1,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-
-typedef int32_t s32;
-
-typedef uint8_t u8;
-typedef uint32_t u32;
+#include "types.h"
+#include "input_file.h"
+#include "memory_arena.h"
 
 #define ArrayCount(a) (sizeof(a) / sizeof(a[0]))
 
 typedef struct
 {
-    s32 Count;
+    s64 Count;
     u8 *Data;
 } buffer;
 
@@ -50,3 +48,13 @@ typedef struct
     u8 *Set;
     s32 NextState;
 } html_transition_entry;
+
+/* NOTE: a run of input bytes that left the DFA in the same state. Tokens are allocated
+   from the parse arena and point into the input buffer by offset. */
+typedef struct html_token
+{
+    struct html_token *Next;
+    s32 State;
+    s64 Offset;
+    s64 Count;
+} html_token;
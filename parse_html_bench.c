@@ -0,0 +1,124 @@
+#define PARSE_HTML_TRACE 0
+#define PARSE_HTML_NO_MAIN
+#include "parse_html.c"
+#include "bench.h"
+
+static char *BENCH_TAG_NAMES[] = {
+    "div", "span", "p", "a", "li", "ul", "table", "tr", "td", "section",
+    "article", "header", "nav", "button", "custom-element",
+};
+
+static char *BENCH_WORDS[] = {
+    "lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing", "elit",
+    "sed", "do", "eiusmod", "tempor", "incididunt", "ut", "labore", "et", "dolore",
+    "magna", "aliqua", "-", "quis", "nostrud", "exercitation", "ullamco",
+};
+
+static void AppendBenchTag(bench_corpus *Corpus, bench_random *Random)
+{
+    AppendBench(Corpus, "<");
+    AppendBench(Corpus, BENCH_TAG_NAMES[BenchRandom(Random, ArrayCount(BENCH_TAG_NAMES))]);
+    AppendBench(Corpus, ">");
+}
+
+static void AppendBenchComment(bench_corpus *Corpus, bench_random *Random, u32 WordCount)
+{
+    u32 I;
+    AppendBench(Corpus, "<!--");
+    for (I = 0; I < WordCount; ++I)
+    {
+        AppendBench(Corpus, " ");
+        AppendBench(Corpus, BENCH_WORDS[BenchRandom(Random, ArrayCount(BENCH_WORDS))]);
+    }
+    AppendBench(Corpus, " -->");
+}
+
+/* NOTE: mostly tags with the odd short comment */
+static void GenerateTagDenseHtml(bench_corpus *Corpus, s64 Size)
+{
+    bench_random Random = SeedBenchRandom(1);
+    while (Corpus->Size < Size)
+    {
+        if (BenchRandom(&Random, 16) == 0)
+        {
+            AppendBenchComment(Corpus, &Random, 1 + BenchRandom(&Random, 4));
+        }
+        else
+        {
+            AppendBenchTag(Corpus, &Random);
+        }
+    }
+}
+
+/* NOTE: the DFA only accepts text inside comments, so text-heavy means long comments
+   between a few tags */
+static void GenerateTextHeavyHtml(bench_corpus *Corpus, s64 Size)
+{
+    bench_random Random = SeedBenchRandom(2);
+    while (Corpus->Size < Size)
+    {
+        u32 TagCount = 1 + BenchRandom(&Random, 3);
+        while (TagCount--)
+        {
+            AppendBenchTag(Corpus, &Random);
+        }
+        AppendBenchComment(Corpus, &Random, 32 + BenchRandom(&Random, 256));
+    }
+}
+
+static void RunHtmlBench(char *Name, bench_corpus *Corpus, bench_options Options)
+{
+    bench_stats Stats;
+    memory_arena Arena;
+    buffer Buffer;
+    s32 Run;
+    memset(&Stats, 0, sizeof(Stats));
+    InitArena(&Arena, 0);
+    Buffer.Count = Corpus->Size;
+    Buffer.Data = Corpus->Data;
+    for (Run = 0; Run < Options.RepeatCount; ++Run)
+    {
+        bench_sample Sample;
+        html_token *Token;
+        html_token *LastToken = 0;
+        s64 TokenCount = 0;
+        ResetArena(&Arena);
+        Sample = BeginBenchSample();
+        for (Token = ParseHtml(&Buffer, &Arena); Token; Token = Token->Next)
+        {
+            LastToken = Token;
+            ++TokenCount;
+        }
+        EndBenchSample(&Stats, Sample, Buffer.Count, TokenCount);
+        if (LastToken && LastToken->State == html_state_Error)
+        {
+            printf("%s: parse stopped at byte %ld\n", Name, (long)LastToken->Offset);
+        }
+    }
+    PrintBenchStats(Name, &Stats);
+    FreeArena(&Arena);
+}
+
+int main(int ArgCount, char **Args)
+{
+    bench_options Options = ParseBenchOptions(ArgCount, Args);
+    bench_corpus Corpus;
+    PopulateTransitionTable();
+
+    memset(&Corpus, 0, sizeof(Corpus));
+    GenerateTagDenseHtml(&Corpus, Options.CorpusSize);
+    RunHtmlBench("html tag-dense", &Corpus, Options);
+    FreeBenchCorpus(&Corpus);
+
+    GenerateTextHeavyHtml(&Corpus, Options.CorpusSize);
+    RunHtmlBench("html text-heavy", &Corpus, Options);
+    FreeBenchCorpus(&Corpus);
+#ifdef PARSER_INSTRUMENT
+    {
+        FILE *Report = OpenInstrumentReport();
+        WriteHtmlInstrumentReport(Report);
+        CloseInstrumentReport(Report);
+    }
+#endif
+    return 0;
+}
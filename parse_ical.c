@@ -1,5 +1,12 @@
 /* https://www.rfc-editor.org/rfc/rfc3629.txt */
+#define _GNU_SOURCE
 #include "parse_ical.h"
+#include "instrument.h"
+
+/* NOTE: the parser prints the names it reads; benchmarks build with this set to 0 */
+#ifndef PARSE_ICAL_TRACE
+#define PARSE_ICAL_TRACE 1
+#endif
 
 #define CHAR_IS_LOWER_CASE(char) (((char) >= 'a') && ((char) <= 'z'))
 #define CHAR_IS_UPPER_CASE(char) (((char) >= 'A') && ((char) <= 'Z'))
@@ -29,6 +36,9 @@
                              ((char) >= 0x21 && (char) <= 0x7E) ||  \
                              CHAR_IS_NON_USASCII(char))
 
+/* NOTE: the input has no terminator after it (it may be a bare mapping), so reads at or
+   past the end yield 0, which no grammar rule accepts */
+#define CURRENT(buffer, parser) ((parser)->I < (buffer)->Size ? (buffer)->Data[(parser)->I] : 0)
 #define PEEK(buffer, parser) ((parser)->I+1 < (buffer)->Size ? (buffer)->Data[(parser)->I+1] : 0)
 #define PEEK2(buffer, parser) ((parser)->I+2 < (buffer)->Size ? (buffer)->Data[(parser)->I+2] : 0)
 #define PEEK3(buffer, parser) ((parser)->I+3 < (buffer)->Size ? (buffer)->Data[(parser)->I+3] : 0)
@@ -78,66 +88,80 @@ s32 UTF_CHAR_LENGTH_TABLE[32] = {
     [0b11111] = -1, /* should not appear */
 };
 
-static s32 GetUtfCharLength(u8 Char)
-{
-    u8 MaskedChar = (Char >> 3) & 0b00011111;
-    return UTF_CHAR_LENGTH_TABLE[MaskedChar];
-}
+#ifdef PARSER_INSTRUMENT
+static char *ICAL_RULE_NAMES[ical_rule_Count] = {
+    "ContentLine", "Name", "XName", "IanaToken", "Params", "Param", "ParamValue",
+    "ParamRest", "ParamText", "QuotedString", "Value", "Utf", "CRLF",
+};
 
-static void *AllocBuffer(u32 Size)
+/* NOTE: rule bytes include the bytes of the rules nested inside them */
+typedef struct
 {
-    u8 *Data = malloc(sizeof(u8) * Size);
-    buffer *Buffer = malloc(sizeof(buffer));
-    Buffer->Size = Size;
-    Buffer->Data = Data;
-    return Buffer;
-}
+    instrument_rule Rules[ical_rule_Count];
+    instrument_phase Unfold;
+    instrument_phase Parse;
+} ical_instrument;
+
+static ical_instrument ICalInstrument;
 
-static void FreeBuffer(buffer *Buffer)
+static void WriteICalInstrumentReport(FILE *Report)
 {
-    free(Buffer->Data);
-    free(Buffer);
+    instrument_phase Phases[2];
+    s32 I;
+    Phases[0] = ICalInstrument.Unfold;
+    Phases[0].Name = "unfold";
+    Phases[1] = ICalInstrument.Parse;
+    Phases[1].Name = "parse";
+    fprintf(Report, "{\n  \"parser\": \"ical\",\n");
+    WriteInstrumentPhases(Report, Phases, 2);
+    fprintf(Report, ",\n  \"rules\": [");
+    for(I = 0; I < ical_rule_Count; ++I)
+    {
+        fprintf(Report, "%s\n    {\"rule\": \"%s\", \"calls\": %llu, \"bytes\": %llu}", I ? "," : "",
+                ICAL_RULE_NAMES[I], (unsigned long long)ICalInstrument.Rules[I].Calls,
+                (unsigned long long)ICalInstrument.Rules[I].Bytes);
+    }
+    fprintf(Report, "\n  ]\n}\n");
 }
+#endif
 
-static buffer *ReadFileIntoBuffer(char *FilePath)
+static s32 GetUtfCharLength(u8 Char)
 {
-    u32 Size = 0;
-    buffer *Buffer;
-    FILE *File = fopen(FilePath, "rb");
-    if(!File)
-    {
-        return 0;
-    }
-    /* get file size */
-    fseek(File, 0, SEEK_END);
-    Size = ftell(File);
-    /* allocate and write to buffer */
-    Buffer = AllocBuffer(Size);
-    fseek(File, 0, SEEK_SET);
-    fread(Buffer->Data, sizeof(u8), Size, File);
-    fclose(File);
-    return Buffer;
+    u8 MaskedChar = (Char >> 3) & 0b00011111;
+    return UTF_CHAR_LENGTH_TABLE[MaskedChar];
 }
 
-static parser CreateParser()
+static parser CreateParser(memory_arena *Arena)
 {
     parser Parser;
     Parser.State = parser_state_None;
     Parser.I = 0;
     Parser.InAssignment = 0;
+    Parser.Arena = Arena;
+    Parser.FirstLine = 0;
+    Parser.LastLine = 0;
+    Parser.LineCount = 0;
     return Parser;
 }
 
+static buffer BufferSlice(buffer *Buffer, s64 Start, s64 End)
+{
+    buffer Result;
+    Result.Size = End - Start;
+    Result.Data = Buffer->Data + Start;
+    return Result;
+}
+
 #define ERROR_BACK_BUFFER_COUNT 64
 static void ParserError(parser *Parser, buffer *Buffer)
 {
     /* TODO: remove this and just return/handle errors!!!! :( */
     char ErrorChars[ERROR_BACK_BUFFER_COUNT];
-    s32 ErrorIndex;
+    s64 ErrorIndex;
 
-    ErrorIndex = Parser->I - ERROR_BACK_BUFFER_COUNT > 0 ? Parser->I - ERROR_BACK_BUFFER_COUNT : 0;
-    memcpy(ErrorChars, &Buffer->Data[Parser->I-ERROR_BACK_BUFFER_COUNT], Parser->I - ErrorIndex);
-    ErrorChars[ERROR_BACK_BUFFER_COUNT-1] = 0;
+    ErrorIndex = Parser->I - (ERROR_BACK_BUFFER_COUNT-1) > 0 ? Parser->I - (ERROR_BACK_BUFFER_COUNT-1) : 0;
+    memcpy(ErrorChars, &Buffer->Data[ErrorIndex], Parser->I - ErrorIndex);
+    ErrorChars[Parser->I - ErrorIndex] = 0;
     printf("%s\n", ErrorChars);
 
     exit(1);
@@ -145,7 +169,7 @@ static void ParserError(parser *Parser, buffer *Buffer)
 
 static void ExpectChar(parser *Parser, buffer *Buffer, u8 Char)
 {
-    if(Buffer->Data[Parser->I] == Char)
+    if(CURRENT(Buffer, Parser) == Char)
     {
         ++Parser->I;
     }
@@ -158,17 +182,19 @@ static void ExpectChar(parser *Parser, buffer *Buffer, u8 Char)
 
 static void ParseUtf(parser *Parser, buffer *Buffer)
 {
-    s32 CharLength = GetUtfCharLength(Buffer->Data[Parser->I]);
+    s32 CharLength = GetUtfCharLength(CURRENT(Buffer, Parser));
+    INSTRUMENT_RULE_BEGIN(ICalInstrument.Rules[ical_rule_Utf], Parser->I);
     if(CharLength > 0)
     {
-        /* TODO: check if tail is valid */
+        /* NOTE: ParseICal has validated the UTF-8 already, so the tail is well-formed */
         Parser->I += CharLength;
     }
     else
     {
-        printf("unexpected char %d in ParseUtf\n", Buffer->Data[Parser->I]);
+        printf("unexpected char %d in ParseUtf\n", CURRENT(Buffer, Parser));
         ParserError(Parser, Buffer);
     }
+    INSTRUMENT_RULE_END(ICalInstrument.Rules[ical_rule_Utf], Parser->I);
 }
 
 static void ParseIanaToken(parser *Parser, buffer *Buffer)
@@ -177,11 +203,14 @@ static void ParseIanaToken(parser *Parser, buffer *Buffer)
       IanaToken    = 1*IanaChar
       IanaChar     = Alpha / Digit / "-"
     */
+    INSTRUMENT_RULE_BEGIN(ICalInstrument.Rules[ical_rule_IanaToken], Parser->I);
     for(;;)
     {
-        if(CHAR_IS_IANA_CHAR(Buffer->Data[Parser->I]))
+        if(CHAR_IS_IANA_CHAR(CURRENT(Buffer, Parser)))
         {
-            printf("%c", Buffer->Data[Parser->I]);
+#if PARSE_ICAL_TRACE
+            printf("%c", CURRENT(Buffer, Parser));
+#endif
             ++Parser->I;
         }
         else
@@ -189,6 +218,7 @@ static void ParseIanaToken(parser *Parser, buffer *Buffer)
             break;
         }
     }
+    INSTRUMENT_RULE_END(ICalInstrument.Rules[ical_rule_IanaToken], Parser->I);
 }
 
 static void ParseXName(parser *Parser, buffer *Buffer)
@@ -199,26 +229,35 @@ static void ParseXName(parser *Parser, buffer *Buffer)
 
     */
     /* NOTE: assume we has already parsed "X-" */
+#if PARSE_ICAL_TRACE
     printf("X-");
-    b32 VendorId1 = CHAR_IS_ALPHANUM(Buffer->Data[Parser->I]);
+#endif
+    b32 VendorId1 = CHAR_IS_ALPHANUM(CURRENT(Buffer, Parser));
     b32 VendorId2 = CHAR_IS_ALPHANUM(PEEK(Buffer, Parser));
     b32 VendorId3 = CHAR_IS_ALPHANUM(PEEK2(Buffer, Parser));
     b32 VendorId4 = PEEK3(Buffer, Parser) == '-';
     b32 IsVendorId = VendorId1 && VendorId2 && VendorId3 && VendorId4;
+    INSTRUMENT_RULE_BEGIN(ICalInstrument.Rules[ical_rule_XName], Parser->I);
     if(IsVendorId)
     {
+#if PARSE_ICAL_TRACE
         printf("%c%c%c%c", Buffer->Data[Parser->I], Buffer->Data[Parser->I+1], Buffer->Data[Parser->I+2], Buffer->Data[Parser->I+3]);
+#endif
         Parser->I += 4;
     }
     ParseIanaToken(Parser, Buffer);
+#if PARSE_ICAL_TRACE
     printf("\n");
+#endif
+    INSTRUMENT_RULE_END(ICalInstrument.Rules[ical_rule_XName], Parser->I);
 }
 
 static void ParseName(parser *Parser, buffer *Buffer)
 {
     /* IanaToken / XName */
     u8 PeekChar = PEEK(Buffer, Parser);
-    if(Buffer->Data[Parser->I] == 'X' && PeekChar == '-')
+    INSTRUMENT_RULE_BEGIN(ICalInstrument.Rules[ical_rule_Name], Parser->I);
+    if(CURRENT(Buffer, Parser) == 'X' && PeekChar == '-')
     {
         Parser->I += 2;
         ParseXName(Parser, Buffer);
@@ -227,7 +266,10 @@ static void ParseName(parser *Parser, buffer *Buffer)
     {
         ParseIanaToken(Parser, Buffer);
     }
+#if PARSE_ICAL_TRACE
     printf("\n");
+#endif
+    INSTRUMENT_RULE_END(ICalInstrument.Rules[ical_rule_Name], Parser->I);
 }
 static void ParseQuotedString(parser *Parser, buffer *Buffer)
 {
@@ -235,11 +277,12 @@ static void ParseQuotedString(parser *Parser, buffer *Buffer)
       QuotedString = "\"" *QsafeChar "\""
       QsafeChar    = WSP / %x21 / %x23-7E / NonUsAscii
     */
+    INSTRUMENT_RULE_BEGIN(ICalInstrument.Rules[ical_rule_QuotedString], Parser->I);
     ExpectChar(Parser, Buffer, '"');
     for(;;)
     {
         /* TODO: parse UTF char-streams? */
-        if(CHAR_IS_Q_SAFE_STRING(Buffer->Data[Parser->I]))
+        if(CHAR_IS_Q_SAFE_STRING(CURRENT(Buffer, Parser)))
         {
             ParseUtf(Parser, Buffer);
         }
@@ -249,6 +292,7 @@ static void ParseQuotedString(parser *Parser, buffer *Buffer)
         }
     }
     ExpectChar(Parser, Buffer, '"');
+    INSTRUMENT_RULE_END(ICalInstrument.Rules[ical_rule_QuotedString], Parser->I);
 }
 
 static void ParamText(parser *Parser, buffer *Buffer)
@@ -257,10 +301,11 @@ static void ParamText(parser *Parser, buffer *Buffer)
       ParamText    = *SafeChar
       SafeChar     = WSP / %x21 / %x23-2B / %x2D-39 / %x3C-7E / NonUsAscii
     */
+    INSTRUMENT_RULE_BEGIN(ICalInstrument.Rules[ical_rule_ParamText], Parser->I);
     for(;;)
     {
         /* TODO: parse UTF char-streams? */
-        if(CHAR_IS_SAFE_CHAR(Buffer->Data[Parser->I]))
+        if(CHAR_IS_SAFE_CHAR(CURRENT(Buffer, Parser)))
         {
             ParseUtf(Parser, Buffer);
         }
@@ -269,6 +314,7 @@ static void ParamText(parser *Parser, buffer *Buffer)
             break;
         }
     }
+    INSTRUMENT_RULE_END(ICalInstrument.Rules[ical_rule_ParamText], Parser->I);
 }
 
 static void ParseParamValue(parser *Parser, buffer *Buffer)
@@ -279,7 +325,8 @@ static void ParseParamValue(parser *Parser, buffer *Buffer)
       SafeChar     = WSP / %x21 / %x23-2B / %x2D-39 / %x3C-7E / NonUsAscii
       QuotedString = "\"" *QsafeChar "\""
     */
-    if(Buffer->Data[Parser->I] == '"')
+    INSTRUMENT_RULE_BEGIN(ICalInstrument.Rules[ical_rule_ParamValue], Parser->I);
+    if(CURRENT(Buffer, Parser) == '"')
     {
         ParseQuotedString(Parser, Buffer);
     }
@@ -287,14 +334,16 @@ static void ParseParamValue(parser *Parser, buffer *Buffer)
     {
         ParamText(Parser, Buffer);
     }
+    INSTRUMENT_RULE_END(ICalInstrument.Rules[ical_rule_ParamValue], Parser->I);
 }
 
 static void ParseParamRest(parser *Parser, buffer *Buffer)
 {
     /* "," ParamValue */
+    INSTRUMENT_RULE_BEGIN(ICalInstrument.Rules[ical_rule_ParamRest], Parser->I);
     for(;;)
     {
-        if(Buffer->Data[Parser->I] == ',')
+        if(CURRENT(Buffer, Parser) == ',')
         {
             ++Parser->I;
             ParseParamValue(Parser, Buffer);
@@ -304,23 +353,48 @@ static void ParseParamRest(parser *Parser, buffer *Buffer)
             break;
         }
     }
+    INSTRUMENT_RULE_END(ICalInstrument.Rules[ical_rule_ParamRest], Parser->I);
 }
 
 static void ParseParam(parser *Parser, buffer *Buffer)
 {
     /* Name "=" ParamValue *ParamRest */
+    content_line_param *Param = PushStruct(Parser->Arena, content_line_param);
+    content_line *Line = Parser->LastLine;
+    s64 Start = Parser->I;
+    if(!Param)
+    {
+        Parser->State = parser_state_OutOfMemory;
+        return;
+    }
+    INSTRUMENT_RULE_BEGIN(ICalInstrument.Rules[ical_rule_Param], Parser->I);
     ParseName(Parser, Buffer);
+    Param->Next = 0;
+    Param->Name = BufferSlice(Buffer, Start, Parser->I);
     ExpectChar(Parser, Buffer, '=');
+    Start = Parser->I;
     ParseParamValue(Parser, Buffer);
     ParseParamRest(Parser, Buffer);
+    Param->Value = BufferSlice(Buffer, Start, Parser->I);
+    if(Line->LastParam)
+    {
+        Line->LastParam->Next = Param;
+    }
+    else
+    {
+        Line->FirstParam = Param;
+    }
+    Line->LastParam = Param;
+    INSTRUMENT_RULE_END(ICalInstrument.Rules[ical_rule_Param], Parser->I);
 }
 
 static void ParseParams(parser *Parser, buffer *Buffer)
 {
     /* *(";" Param) */
+    INSTRUMENT_RULE_BEGIN(ICalInstrument.Rules[ical_rule_Params], Parser->I);
     for(;;)
     {
-        if(Buffer->Data[Parser->I] == ';')
+        if(CURRENT(Buffer, Parser) == ';' && Parser->State == parser_state_ContentLine)
         {
             ++Parser->I;
             ParseParam(Parser, Buffer);
@@ -330,6 +404,7 @@ static void ParseParams(parser *Parser, buffer *Buffer)
             break;
         }
     }
+    INSTRUMENT_RULE_END(ICalInstrument.Rules[ical_rule_Params], Parser->I);
 }
 
 static void ParseValue(parser *Parser, buffer *Buffer)
@@ -340,9 +415,12 @@ static void ParseValue(parser *Parser, buffer *Buffer)
       FIRST(ValueChar) = ' ' / '\t' / %x21-7E / FIRST(NonUsAscii)
       FIRST(NonUsAscii) = %xC2-DF / %xE0 / %xE1-EC / %xED / %xEE-EF
     */
+    INSTRUMENT_RULE_BEGIN(ICalInstrument.Rules[ical_rule_Value], Parser->I);
+    /* NOTE: skip the ASCII in bulk, the loop below takes the rest */
+    Parser->I += ScanKernels.SkipPrintable(Buffer->Data + Parser->I, Buffer->Size - Parser->I);
     for(;;)
     {
-        if(CHAR_IS_VALUE(Buffer->Data[Parser->I]))
+        if(CHAR_IS_VALUE(CURRENT(Buffer, Parser)))
         {
             ParseUtf(Parser, Buffer);
         }
@@ -351,11 +429,13 @@ static void ParseValue(parser *Parser, buffer *Buffer)
             break;
         }
     }
+    INSTRUMENT_RULE_END(ICalInstrument.Rules[ical_rule_Value], Parser->I);
 }
 
 static void ParseCRLF(parser *Parser, buffer *Buffer)
 {
-    u8 Char = Buffer->Data[Parser->I];
+    u8 Char = CURRENT(Buffer, Parser);
+    INSTRUMENT_RULE_BEGIN(ICalInstrument.Rules[ical_rule_CRLF], Parser->I);
     if(Char == char_code_CR)
     {
         ExpectChar(Parser, Buffer, char_code_CR);
@@ -365,28 +445,86 @@ static void ParseCRLF(parser *Parser, buffer *Buffer)
     {
         ++Parser->I;
     }
+    else if(Parser->I == Buffer->Size)
+    {
+        /* NOTE: accept a last line without a line break */
+    }
     else
     {
-        printf("[ Error ] expected newline sequence %d\n", Parser->I);
+        printf("[ Error ] expected newline sequence %ld\n", (long)Parser->I);
         ParserError(Parser, Buffer);
     }
+    INSTRUMENT_RULE_END(ICalInstrument.Rules[ical_rule_CRLF], Parser->I);
 }
 
 static void ParseContentLine(parser *Parser, buffer *Buffer)
 {
     /* Name Params ":" Value CRLF */
+    content_line *Line = PushStruct(Parser->Arena, content_line);
+    content_line *PreviousLine = Parser->LastLine;
+    s64 Start = Parser->I;
+    if(!Line)
+    {
+        Parser->State = parser_state_OutOfMemory;
+        return;
+    }
+    INSTRUMENT_RULE_BEGIN(ICalInstrument.Rules[ical_rule_ContentLine], Parser->I);
+    Line->Next = 0;
+    Line->FirstParam = 0;
+    Line->LastParam = 0;
+    if(Parser->LastLine)
+    {
+        Parser->LastLine->Next = Line;
+    }
+    else
+    {
+        Parser->FirstLine = Line;
+    }
+    Parser->LastLine = Line;
+    ++Parser->LineCount;
+
     ParseName(Parser, Buffer);
+    Line->Name = BufferSlice(Buffer, Start, Parser->I);
     ParseParams(Parser, Buffer);
+    if(Parser->State == parser_state_OutOfMemory)
+    {
+        /* NOTE: drop the unfinished line so the caller only sees complete ones */
+        if(PreviousLine)
+        {
+            PreviousLine->Next = 0;
+        }
+        else
+        {
+            Parser->FirstLine = 0;
+        }
+        Parser->LastLine = PreviousLine;
+        --Parser->LineCount;
+        INSTRUMENT_RULE_END(ICalInstrument.Rules[ical_rule_ContentLine], Parser->I);
+        return;
+    }
     ExpectChar(Parser, Buffer, ':');
+    Start = Parser->I;
     ParseValue(Parser, Buffer);
+    Line->Value = BufferSlice(Buffer, Start, Parser->I);
     ParseCRLF(Parser, Buffer);
+    INSTRUMENT_RULE_END(ICalInstrument.Rules[ical_rule_ContentLine], Parser->I);
 }
 
-static void ParseICal(buffer *Buffer)
+/* NOTE: returns the content lines in document order */
+static content_line *ParseICal(buffer *Buffer, memory_arena *Arena)
 {
     b32 Running = 1;
-    parser Parser = CreateParser();
+    parser Parser = CreateParser(Arena);
+    s64 ValidSize;
     Parser.State = parser_state_ContentLine;
+    INSTRUMENT_PHASE_BEGIN(ICalInstrument.Parse);
+    ValidSize = ScanKernels.ValidateUtf8(Buffer->Data, Buffer->Size);
+    if(ValidSize < Buffer->Size)
+    {
+        printf("[ Error ] invalid UTF-8 at %ld\n", (long)ValidSize);
+        Parser.I = ValidSize;
+        Parser.State = parser_state_Error;
+    }
     while(Running && Parser.I < Buffer->Size)
     {
         switch(Parser.State)
@@ -398,55 +536,80 @@ static void ParseICal(buffer *Buffer)
             ParserError(&Parser, Buffer);
             Running = 0;
             break;
+        case parser_state_OutOfMemory:
+            /* NOTE: return the content lines parsed so far */
+            printf("[ Error ] out of memory after %ld content lines\n", (long)Parser.LineCount);
+            Running = 0;
+            break;
         default:
             Running = 0;
             break;
         }
     }
+    INSTRUMENT_PHASE_END(ICalInstrument.Parse);
+    return Parser.FirstLine;
 }
 
+/* NOTE: unfolds CRLF or LF followed by a space or tab, in place. A newline never occurs
+   inside a UTF-8 sequence, so the folds can be found without decoding. */
 static void RemoveLineContinuations(buffer *Buffer)
 {
-    /* TODO: parse UTF char-streams to prevent detecting line-continuations mid utf-octet-stream */
+    s64 ReadIndex = 0, WriteIndex = 0;
     if(!Buffer) return; /* return and handle error :( */
+#if PARSE_ICAL_TRACE
     printf("RemoveLineContinuations\n");
-    s32 BufferIndex, WriteIndex = 0, ContinuationCount = 0;
-    for(BufferIndex = 0; BufferIndex < Buffer->Size; ++BufferIndex)
+#endif
+    INSTRUMENT_PHASE_BEGIN(ICalInstrument.Unfold);
+    for(;;)
     {
-        s32 RemainingCharCount = (Buffer->Size - 1) - BufferIndex;
-        if(RemainingCharCount >= 3)
+        s64 Fold = ReadIndex + ScanKernels.FindFold(Buffer->Data + ReadIndex, Buffer->Size - ReadIndex);
+        s64 End = Fold;
+        if(Fold < Buffer->Size && Fold > ReadIndex && Buffer->Data[Fold-1] == char_code_CR)
+        {
+            --End;
+        }
+        if(WriteIndex != ReadIndex)
+        {
+            memmove(Buffer->Data + WriteIndex, Buffer->Data + ReadIndex, End - ReadIndex);
+        }
+        WriteIndex += End - ReadIndex;
+        if(Fold >= Buffer->Size)
         {
-            u8 Char1 = Buffer->Data[BufferIndex];
-            u8 Char2 = Buffer->Data[BufferIndex+1];
-            u8 Char3 = Buffer->Data[BufferIndex+2];
-            b32 NewlineSpace = Char1 == char_code_Newline && CHAR_IS_SPACE(Char2); /* TODO: newline-space might _not_ be spec */
-            b32 Char2Newline = Char2 == '\n' || Char2 == char_code_LF;
-            b32 CRLFSpace = Char1 == char_code_CR && Char2Newline && CHAR_IS_SPACE(Char3);
-            if(NewlineSpace || CRLFSpace)
-            {
-                BufferIndex += 3;
-                ++ContinuationCount;
-            }
+            break;
         }
-        Buffer->Data[WriteIndex] = Buffer->Data[BufferIndex];
-        ++WriteIndex;
+        ReadIndex = Fold + 2;
     }
-    Buffer->Size -= 3 * ContinuationCount;
+    Buffer->Size = WriteIndex;
+    INSTRUMENT_PHASE_END(ICalInstrument.Unfold);
 }
 
+#ifndef PARSE_ICAL_NO_MAIN
 static void TestParseICal()
 {
     char *FilePath = "./__test2.ics";
-    buffer *Buffer = ReadFileIntoBuffer(FilePath);
-    if(Buffer)
+    /* NOTE: RemoveLineContinuations unfolds in place, so the mapping must be writable */
+    input_file File = OpenInputFile(FilePath, input_file_flag_Writable);
+    if(File.Kind != input_file_kind_None)
     {
-        printf("BufferSize %d\n", Buffer->Size);
-        RemoveLineContinuations(Buffer);
-        printf("BufferSize %d\n", Buffer->Size);
-        /* for(I = 0; I < Buffer->Size; ++I) printf("%c", Buffer->Data[I]); */
+        buffer Buffer;
+        memory_arena Arena;
+        content_line *Line;
+        s64 LineCount = 0;
+        Buffer.Size = File.Size;
+        Buffer.Data = File.Data;
+        printf("BufferSize %ld\n", (long)Buffer.Size);
+        RemoveLineContinuations(&Buffer);
+        printf("BufferSize %ld\n", (long)Buffer.Size);
+        /* for(I = 0; I < Buffer.Size; ++I) printf("%c", Buffer.Data[I]); */
         /* printf("\n"); */
-        ParseICal(Buffer);
-        FreeBuffer(Buffer);
+        InitArena(&Arena, 0);
+        for(Line = ParseICal(&Buffer, &Arena); Line; Line = Line->Next)
+        {
+            ++LineCount;
+        }
+        printf("ContentLineCount %ld ArenaHighWaterMark %ld\n", (long)LineCount, (long)Arena.HighWaterMark);
+        FreeArena(&Arena);
+        CloseInputFile(&File);
     }
     else
     {
@@ -455,7 +618,21 @@ static void TestParseICal()
 }
 
 
+#ifdef PARSER_INSTRUMENT
+/* NOTE: ParserError exits the process, so the report is written at exit */
+static void WriteICalInstrumentReportAtExit(void)
+{
+    FILE *Report = OpenInstrumentReport();
+    WriteICalInstrumentReport(Report);
+    CloseInstrumentReport(Report);
+}
+#endif
+
 int main()
 {
+#ifdef PARSER_INSTRUMENT
+    atexit(WriteICalInstrumentReportAtExit);
+#endif
     TestParseICal();
 }
+#endif
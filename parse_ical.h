@@ -1,13 +1,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-
-typedef uint8_t u8;
-typedef uint32_t u32;
-
-typedef int32_t s32;
-
-typedef uint32_t b32;
+#include "types.h"
+#include "input_file.h"
+#include "memory_arena.h"
+#include "scan_kernels.h"
 
 typedef size_t size;
 
@@ -20,24 +17,65 @@ typedef enum
 
 typedef struct
 {
-    s32 Size;
+    s64 Size;
     u8 *Data;
 } buffer;
 
+/* NOTE: parser output is allocated from the parser's arena and slices the input buffer */
+typedef struct content_line_param
+{
+    struct content_line_param *Next;
+    buffer Name;
+    buffer Value;
+} content_line_param;
+
+typedef struct content_line
+{
+    struct content_line *Next;
+    buffer Name;
+    content_line_param *FirstParam;
+    content_line_param *LastParam;
+    buffer Value;
+} content_line;
+
 typedef enum
 {
     parser_state_None,
     parser_state_Error,
     parser_state_ContentLine,
+    parser_state_OutOfMemory,
 } parser_state;
 
 typedef struct
 {
     parser_state State;
-    s32 I;
+    s64 I;
     b32 InAssignment;
+    memory_arena *Arena;
+    content_line *FirstLine;
+    content_line *LastLine;
+    s64 LineCount;
 } parser;
 
+/* NOTE: grammar rules counted when built with PARSER_INSTRUMENT, see instrument.h */
+typedef enum
+{
+    ical_rule_ContentLine,
+    ical_rule_Name,
+    ical_rule_XName,
+    ical_rule_IanaToken,
+    ical_rule_Params,
+    ical_rule_Param,
+    ical_rule_ParamValue,
+    ical_rule_ParamRest,
+    ical_rule_ParamText,
+    ical_rule_QuotedString,
+    ical_rule_Value,
+    ical_rule_Utf,
+    ical_rule_CRLF,
+    ical_rule_Count,
+} ical_rule;
+
 char *DebugParserState(parser_state State);
 
 char *DebugParserState(parser_state State)
@@ -47,6 +85,7 @@ char *DebugParserState(parser_state State)
     case parser_state_None: return "None";
     case parser_state_Error: return "Error";
     case parser_state_ContentLine: return "ContentLine";
+    case parser_state_OutOfMemory: return "OutOfMemory";
     default: return "<Unspecified>";
     }
 }
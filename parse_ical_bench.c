@@ -0,0 +1,180 @@
+#define PARSE_ICAL_TRACE 0
+#define PARSE_ICAL_NO_MAIN
+#include "parse_ical.c"
+#include "bench.h"
+
+#define ArrayCount(a) (sizeof(a) / sizeof(a[0]))
+#define ICAL_FOLD_WIDTH 75
+
+static char *BENCH_WORDS[] = {
+    "meeting", "agenda", "review", "quarterly", "planning", "sync", "budget", "roadmap",
+    "notes", "follow-up", "caf\xc3\xa9", "r\xc3\xa9sum\xc3\xa9", "action", "items", "(draft)",
+    "https://example.com/join?id=42", "team", "offsite",
+};
+
+static char *BENCH_NAMES[] = {
+    "Ada Lovelace", "Grace Hopper", "Alan Turing", "Edsger Dijkstra", "Barbara Liskov",
+};
+
+/* NOTE: folds after every ICAL_FOLD_WIDTH octets with CRLF SPACE, never inside a UTF-8
+   sequence */
+static void AppendFoldedLine(bench_corpus *Corpus, u8 *Line, s64 Count)
+{
+    s64 I;
+    s64 LineWidth = 0;
+    for (I = 0; I < Count; ++I)
+    {
+        if (LineWidth >= ICAL_FOLD_WIDTH && (Line[I] & 0xC0) != 0x80)
+        {
+            AppendBench(Corpus, "\r\n ");
+            LineWidth = 1;
+        }
+        AppendBenchBytes(Corpus, &Line[I], 1);
+        ++LineWidth;
+    }
+    AppendBench(Corpus, "\r\n");
+}
+
+static void AppendBenchWords(bench_corpus *Line, bench_random *Random, u32 WordCount)
+{
+    u32 I;
+    for (I = 0; I < WordCount; ++I)
+    {
+        if (I > 0)
+        {
+            AppendBench(Line, " ");
+        }
+        AppendBench(Line, BENCH_WORDS[BenchRandom(Random, ArrayCount(BENCH_WORDS))]);
+    }
+}
+
+static void AppendBenchDateTime(bench_corpus *Corpus, bench_random *Random)
+{
+    AppendBench(Corpus, "2022");
+    AppendBenchNumber(Corpus, 1 + BenchRandom(Random, 12), 2);
+    AppendBenchNumber(Corpus, 1 + BenchRandom(Random, 28), 2);
+    AppendBench(Corpus, "T");
+    AppendBenchNumber(Corpus, BenchRandom(Random, 24), 2);
+    AppendBenchNumber(Corpus, BenchRandom(Random, 60), 2);
+    AppendBench(Corpus, "00");
+}
+
+static void AppendBenchEvent(bench_corpus *Corpus, bench_corpus *Line, bench_random *Random,
+                             u32 EventIndex, u32 DescriptionWords)
+{
+    u32 AttendeeCount = 1 + BenchRandom(Random, 4);
+    AppendBench(Corpus, "BEGIN:VEVENT\r\nUID:");
+    AppendBenchNumber(Corpus, EventIndex, 10);
+    AppendBench(Corpus, "@example.com\r\nDTSTAMP:");
+    AppendBenchDateTime(Corpus, Random);
+    AppendBench(Corpus, "Z\r\nDTSTART;TZID=America/New_York:");
+    AppendBenchDateTime(Corpus, Random);
+    AppendBench(Corpus, "\r\nDTEND;TZID=America/New_York:");
+    AppendBenchDateTime(Corpus, Random);
+    AppendBench(Corpus, "\r\n");
+
+    Line->Size = 0;
+    AppendBench(Line, "SUMMARY;LANGUAGE=en-US:");
+    AppendBenchWords(Line, Random, 2 + BenchRandom(Random, 6));
+    AppendFoldedLine(Corpus, Line->Data, Line->Size);
+
+    Line->Size = 0;
+    AppendBench(Line, "DESCRIPTION:");
+    AppendBenchWords(Line, Random, DescriptionWords);
+    AppendFoldedLine(Corpus, Line->Data, Line->Size);
+
+    while (AttendeeCount--)
+    {
+        Line->Size = 0;
+        AppendBench(Line, "ATTENDEE;ROLE=REQ-PARTICIPANT;PARTSTAT=NEEDS-ACTION;RSVP=TRUE;CN=\"");
+        AppendBench(Line, BENCH_NAMES[BenchRandom(Random, ArrayCount(BENCH_NAMES))]);
+        AppendBench(Line, "\":mailto:person");
+        AppendBenchNumber(Line, BenchRandom(Random, 1000), 3);
+        AppendBench(Line, "@example.com");
+        AppendFoldedLine(Corpus, Line->Data, Line->Size);
+    }
+    AppendBench(Corpus, "X-MICROSOFT-CDO-BUSYSTATUS:BUSY\r\nEND:VEVENT\r\n");
+}
+
+/* NOTE: DescriptionWords picks the shape: a few words gives many small VEVENTs, a few
+   hundred gives long DESCRIPTIONs folded over many lines */
+static void GenerateCalendar(bench_corpus *Corpus, s64 Size, u32 DescriptionWords, u64 Seed)
+{
+    bench_random Random = SeedBenchRandom(Seed);
+    bench_corpus Line;
+    u32 EventIndex = 0;
+    memset(&Line, 0, sizeof(Line));
+    AppendBench(Corpus, "BEGIN:VCALENDAR\r\nVERSION:2.0\r\nPRODID:-//parsers//bench//EN\r\n");
+    while (Corpus->Size < Size)
+    {
+        u32 Words = DescriptionWords / 2 + BenchRandom(&Random, DescriptionWords + 1);
+        AppendBenchEvent(Corpus, &Line, &Random, EventIndex++, Words);
+    }
+    AppendBench(Corpus, "END:VCALENDAR\r\n");
+    FreeBenchCorpus(&Line);
+}
+
+static void RunICalBench(char *Name, bench_corpus *Corpus, bench_options Options)
+{
+    bench_stats UnfoldStats, ParseStats;
+    char StatsName[64];
+    memory_arena Arena;
+    buffer Buffer;
+    u8 *Data = malloc(Corpus->Size);
+    s32 Run;
+    memset(&UnfoldStats, 0, sizeof(UnfoldStats));
+    memset(&ParseStats, 0, sizeof(ParseStats));
+    InitArena(&Arena, 0);
+    for (Run = 0; Run < Options.RepeatCount; ++Run)
+    {
+        bench_sample Sample;
+        content_line *Line;
+        s64 LineCount = 0;
+        /* NOTE: unfolding works in place, so every run starts from a fresh copy */
+        memcpy(Data, Corpus->Data, Corpus->Size);
+        Buffer.Size = Corpus->Size;
+        Buffer.Data = Data;
+        ResetArena(&Arena);
+
+        Sample = BeginBenchSample();
+        RemoveLineContinuations(&Buffer);
+        EndBenchSample(&UnfoldStats, Sample, Corpus->Size, 0);
+
+        Sample = BeginBenchSample();
+        for (Line = ParseICal(&Buffer, &Arena); Line; Line = Line->Next)
+        {
+            ++LineCount;
+        }
+        EndBenchSample(&ParseStats, Sample, Buffer.Size, LineCount);
+        UnfoldStats.Records = LineCount;
+    }
+    sprintf(StatsName, "%s unfold", Name);
+    PrintBenchStats(StatsName, &UnfoldStats);
+    sprintf(StatsName, "%s parse", Name);
+    PrintBenchStats(StatsName, &ParseStats);
+    FreeArena(&Arena);
+    free(Data);
+}
+
+int main(int ArgCount, char **Args)
+{
+    bench_options Options = ParseBenchOptions(ArgCount, Args);
+    bench_corpus Corpus;
+
+    memset(&Corpus, 0, sizeof(Corpus));
+    GenerateCalendar(&Corpus, Options.CorpusSize, 8, 1);
+    RunICalBench("ical many-events", &Corpus, Options);
+    FreeBenchCorpus(&Corpus);
+
+    GenerateCalendar(&Corpus, Options.CorpusSize, 300, 2);
+    RunICalBench("ical folded", &Corpus, Options);
+    FreeBenchCorpus(&Corpus);
+#ifdef PARSER_INSTRUMENT
+    {
+        FILE *Report = OpenInstrumentReport();
+        WriteICalInstrumentReport(Report);
+        CloseInstrumentReport(Report);
+    }
+#endif
+    return 0;
+}
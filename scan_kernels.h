@@ -0,0 +1,581 @@
+/*
+  Byte-scanning kernels shared by the parsers, dispatched on the features of the CPU that
+  runs the binary.
+
+  The build targets the baseline ISA, so the vector variants are compiled with per-function
+  target attributes and only bound when cpuid (and xgetbv, for the AVX state the OS saves)
+  says they can run. Detection happens once, before main, and ScanKernels starts out bound
+  to the scalar reference so that it is usable even where there is no constructor.
+
+  Every kernel takes a pointer and a byte count and returns an offset, Count meaning "not
+  found" (or "all valid"). The scalar variants define the expected results; see
+  scan_kernels_test.c. SCAN_KERNELS=scalar|sse2|avx2|avx512 in the environment lowers the
+  level that is bound, which is handy for benchmarking.
+*/
+#ifndef SCAN_KERNELS_H
+#define SCAN_KERNELS_H
+
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SCAN_KERNELS_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#else
+#define SCAN_KERNELS_X86 0
+#endif
+
+/* NOTE: offset of the first Byte */
+typedef s64 find_byte_kernel(u8 *Data, s64 Count, u8 Byte);
+/* NOTE: offset of the first "\n" followed by a space or tab, i.e. a folded line */
+typedef s64 find_fold_kernel(u8 *Data, s64 Count);
+/* NOTE: length of the leading run of printable ASCII and tabs */
+typedef s64 skip_printable_kernel(u8 *Data, s64 Count);
+/* NOTE: offset of the first invalid UTF-8 sequence (RFC 3629) */
+typedef s64 validate_utf8_kernel(u8 *Data, s64 Count);
+
+typedef enum
+{
+    scan_level_Scalar,
+    scan_level_SSE2,
+    scan_level_AVX2,
+    scan_level_AVX512,
+    scan_level_Count,
+} scan_level;
+
+typedef struct
+{
+    char *Name;
+    find_byte_kernel *FindByte;
+    find_fold_kernel *FindFold;
+    skip_printable_kernel *SkipPrintable;
+    validate_utf8_kernel *ValidateUtf8;
+} scan_kernels;
+
+scan_level DetectScanLevel(void);
+void InitScanKernels(void);
+s32 Utf8SequenceLength(u8 *Data, s64 Count);
+
+/* NOTE: returns the length of the well-formed sequence at Data, or 0 */
+s32 Utf8SequenceLength(u8 *Data, s64 Count)
+{
+    u8 Lead = Data[0];
+    u8 Low = 0x80, High = 0xBF;
+    s32 Length, I;
+    if(Lead < 0x80)
+    {
+        return 1;
+    }
+    else if(Lead >= 0xC2 && Lead <= 0xDF)
+    {
+        Length = 2;
+    }
+    else if(Lead >= 0xE0 && Lead <= 0xEF)
+    {
+        Length = 3;
+        /* NOTE: no overlong forms and no surrogates */
+        if(Lead == 0xE0) Low = 0xA0;
+        if(Lead == 0xED) High = 0x9F;
+    }
+    else if(Lead >= 0xF0 && Lead <= 0xF4)
+    {
+        Length = 4;
+        /* NOTE: no overlong forms and nothing past U+10FFFF */
+        if(Lead == 0xF0) Low = 0x90;
+        if(Lead == 0xF4) High = 0x8F;
+    }
+    else
+    {
+        return 0;
+    }
+    if(Count < Length || Data[1] < Low || Data[1] > High)
+    {
+        return 0;
+    }
+    for(I = 2; I < Length; ++I)
+    {
+        if(Data[I] < 0x80 || Data[I] > 0xBF)
+        {
+            return 0;
+        }
+    }
+    return Length;
+}
+
+#define SCAN_IS_PRINTABLE(Char) (((Char) >= 0x20 && (Char) <= 0x7E) || (Char) == '\t')
+
+static s64 FindByteScalar(u8 *Data, s64 Count, u8 Byte)
+{
+    s64 I;
+    for(I = 0; I < Count && Data[I] != Byte; ++I);
+    return I;
+}
+
+static s64 FindFoldScalar(u8 *Data, s64 Count)
+{
+    s64 I;
+    for(I = 0; I + 1 < Count; ++I)
+    {
+        if(Data[I] == '\n' && (Data[I+1] == ' ' || Data[I+1] == '\t'))
+        {
+            return I;
+        }
+    }
+    return Count;
+}
+
+static s64 SkipPrintableScalar(u8 *Data, s64 Count)
+{
+    s64 I;
+    for(I = 0; I < Count && SCAN_IS_PRINTABLE(Data[I]); ++I);
+    return I;
+}
+
+static s64 ValidateUtf8Scalar(u8 *Data, s64 Count)
+{
+    s64 I = 0;
+    while(I < Count)
+    {
+        s32 Length = Utf8SequenceLength(Data + I, Count - I);
+        if(!Length)
+        {
+            return I;
+        }
+        I += Length;
+    }
+    return Count;
+}
+
+#if SCAN_KERNELS_X86
+/*
+  The vector variants handle whole blocks. Where only the first match matters (FindByte,
+  SkipPrintable) the last block is loaded so that it ends at Count, overlapping bytes that
+  are already known not to match; short fields are common, so this beats a scalar tail.
+  Otherwise the tail goes to the scalar variant, or to the next narrower one for AVX-512.
+  A fold needs the byte after the newline, so FindFold only takes blocks that have one
+  more byte after them.
+
+  FindByteAVX2 and SkipPrintableAVX2 handle inputs shorter than a block themselves with
+  16-byte loads rather than calling the SSE2 variants: most AWS log fields are shorter
+  than 32 bytes, so this path runs for nearly every field and is kept free of a call.
+*/
+static s64 FindByteSSE2(u8 *Data, s64 Count, u8 Byte)
+{
+    __m128i Needle = _mm_set1_epi8((char)Byte);
+    s64 I;
+    u32 Mask;
+    if(Count < 16)
+    {
+        return FindByteScalar(Data, Count, Byte);
+    }
+    for(I = 0; I + 16 < Count; I += 16)
+    {
+        Mask = (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)(Data + I)), Needle));
+        if(Mask)
+        {
+            return I + __builtin_ctz(Mask);
+        }
+    }
+    I = Count - 16;
+    Mask = (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)(Data + I)), Needle));
+    return Mask ? I + __builtin_ctz(Mask) : Count;
+}
+
+static s64 FindFoldSSE2(u8 *Data, s64 Count)
+{
+    __m128i Newline = _mm_set1_epi8('\n');
+    __m128i Space = _mm_set1_epi8(' ');
+    __m128i Tab = _mm_set1_epi8('\t');
+    s64 I;
+    for(I = 0; I + 17 <= Count; I += 16)
+    {
+        __m128i Block = _mm_loadu_si128((__m128i *)(Data + I));
+        __m128i Next = _mm_loadu_si128((__m128i *)(Data + I + 1));
+        __m128i Fold = _mm_and_si128(_mm_cmpeq_epi8(Block, Newline),
+                                     _mm_or_si128(_mm_cmpeq_epi8(Next, Space), _mm_cmpeq_epi8(Next, Tab)));
+        u32 Mask = (u32)_mm_movemask_epi8(Fold);
+        if(Mask)
+        {
+            return I + __builtin_ctz(Mask);
+        }
+    }
+    return I + FindFoldScalar(Data + I, Count - I);
+}
+
+/* NOTE: signed compares, so bytes from 0x80 up fail the "greater than 0x1F" test */
+static s64 SkipPrintableSSE2(u8 *Data, s64 Count)
+{
+    __m128i Control = _mm_set1_epi8(0x1F);
+    __m128i Delete = _mm_set1_epi8(0x7F);
+    __m128i Tab = _mm_set1_epi8('\t');
+    __m128i Block, Printable;
+    s64 I;
+    u32 Mask;
+    if(Count < 16)
+    {
+        return SkipPrintableScalar(Data, Count);
+    }
+    for(I = 0; I + 16 < Count; I += 16)
+    {
+        Block = _mm_loadu_si128((__m128i *)(Data + I));
+        Printable = _mm_or_si128(_mm_andnot_si128(_mm_cmpeq_epi8(Block, Delete), _mm_cmpgt_epi8(Block, Control)),
+                                 _mm_cmpeq_epi8(Block, Tab));
+        Mask = ~(u32)_mm_movemask_epi8(Printable) & 0xFFFF;
+        if(Mask)
+        {
+            return I + __builtin_ctz(Mask);
+        }
+    }
+    I = Count - 16;
+    Block = _mm_loadu_si128((__m128i *)(Data + I));
+    Printable = _mm_or_si128(_mm_andnot_si128(_mm_cmpeq_epi8(Block, Delete), _mm_cmpgt_epi8(Block, Control)),
+                             _mm_cmpeq_epi8(Block, Tab));
+    Mask = ~(u32)_mm_movemask_epi8(Printable) & 0xFFFF;
+    return Mask ? I + __builtin_ctz(Mask) : Count;
+}
+
+/* NOTE: ASCII blocks are skipped whole, anything else is checked a sequence at a time */
+static s64 ValidateUtf8SSE2(u8 *Data, s64 Count)
+{
+    s64 I = 0;
+    while(I + 16 <= Count)
+    {
+        u32 Mask = (u32)_mm_movemask_epi8(_mm_loadu_si128((__m128i *)(Data + I)));
+        if(Mask)
+        {
+            s32 Length;
+            I += __builtin_ctz(Mask);
+            Length = Utf8SequenceLength(Data + I, Count - I);
+            if(!Length)
+            {
+                return I;
+            }
+            I += Length;
+        }
+        else
+        {
+            I += 16;
+        }
+    }
+    return I + ValidateUtf8Scalar(Data + I, Count - I);
+}
+
+__attribute__((target("avx2")))
+static s64 FindByteAVX2(u8 *Data, s64 Count, u8 Byte)
+{
+    __m256i Needle = _mm256_set1_epi8((char)Byte);
+    s64 I;
+    u32 Mask;
+    if(Count < 32)
+    {
+        /* NOTE: the same overlapping loads, half as wide */
+        __m128i HalfNeedle = _mm256_castsi256_si128(Needle);
+        if(Count < 16)
+        {
+            return FindByteScalar(Data, Count, Byte);
+        }
+        Mask = (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)Data), HalfNeedle));
+        if(Mask)
+        {
+            return __builtin_ctz(Mask);
+        }
+        I = Count - 16;
+        Mask = (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)(Data + I)), HalfNeedle));
+        return Mask ? I + __builtin_ctz(Mask) : Count;
+    }
+    for(I = 0; I + 32 < Count; I += 32)
+    {
+        Mask = (u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i *)(Data + I)), Needle));
+        if(Mask)
+        {
+            return I + __builtin_ctz(Mask);
+        }
+    }
+    I = Count - 32;
+    Mask = (u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i *)(Data + I)), Needle));
+    return Mask ? I + __builtin_ctz(Mask) : Count;
+}
+
+__attribute__((target("avx2")))
+static s64 FindFoldAVX2(u8 *Data, s64 Count)
+{
+    __m256i Newline = _mm256_set1_epi8('\n');
+    __m256i Space = _mm256_set1_epi8(' ');
+    __m256i Tab = _mm256_set1_epi8('\t');
+    s64 I;
+    for(I = 0; I + 33 <= Count; I += 32)
+    {
+        __m256i Block = _mm256_loadu_si256((__m256i *)(Data + I));
+        __m256i Next = _mm256_loadu_si256((__m256i *)(Data + I + 1));
+        __m256i Fold = _mm256_and_si256(_mm256_cmpeq_epi8(Block, Newline),
+                                        _mm256_or_si256(_mm256_cmpeq_epi8(Next, Space),
+                                                        _mm256_cmpeq_epi8(Next, Tab)));
+        u32 Mask = (u32)_mm256_movemask_epi8(Fold);
+        if(Mask)
+        {
+            return I + __builtin_ctz(Mask);
+        }
+    }
+    return I + FindFoldScalar(Data + I, Count - I);
+}
+
+__attribute__((target("avx2")))
+static s64 SkipPrintableAVX2(u8 *Data, s64 Count)
+{
+    __m256i Control = _mm256_set1_epi8(0x1F);
+    __m256i Delete = _mm256_set1_epi8(0x7F);
+    __m256i Tab = _mm256_set1_epi8('\t');
+    __m256i Block, Printable;
+    s64 I;
+    u32 Mask;
+    if(Count < 32)
+    {
+        __m128i HalfBlock, HalfPrintable;
+        s32 Half;
+        if(Count < 16)
+        {
+            return SkipPrintableScalar(Data, Count);
+        }
+        for(Half = 0; Half < 2; ++Half)
+        {
+            I = Half ? Count - 16 : 0;
+            HalfBlock = _mm_loadu_si128((__m128i *)(Data + I));
+            HalfPrintable = _mm_or_si128(_mm_andnot_si128(_mm_cmpeq_epi8(HalfBlock, _mm256_castsi256_si128(Delete)),
+                                                          _mm_cmpgt_epi8(HalfBlock, _mm256_castsi256_si128(Control))),
+                                         _mm_cmpeq_epi8(HalfBlock, _mm256_castsi256_si128(Tab)));
+            Mask = ~(u32)_mm_movemask_epi8(HalfPrintable) & 0xFFFF;
+            if(Mask)
+            {
+                return I + __builtin_ctz(Mask);
+            }
+        }
+        return Count;
+    }
+    for(I = 0; I + 32 < Count; I += 32)
+    {
+        Block = _mm256_loadu_si256((__m256i *)(Data + I));
+        Printable = _mm256_or_si256(_mm256_andnot_si256(_mm256_cmpeq_epi8(Block, Delete),
+                                                        _mm256_cmpgt_epi8(Block, Control)),
+                                    _mm256_cmpeq_epi8(Block, Tab));
+        Mask = ~(u32)_mm256_movemask_epi8(Printable);
+        if(Mask)
+        {
+            return I + __builtin_ctz(Mask);
+        }
+    }
+    I = Count - 32;
+    Block = _mm256_loadu_si256((__m256i *)(Data + I));
+    Printable = _mm256_or_si256(_mm256_andnot_si256(_mm256_cmpeq_epi8(Block, Delete),
+                                                    _mm256_cmpgt_epi8(Block, Control)),
+                                _mm256_cmpeq_epi8(Block, Tab));
+    Mask = ~(u32)_mm256_movemask_epi8(Printable);
+    return Mask ? I + __builtin_ctz(Mask) : Count;
+}
+
+__attribute__((target("avx2")))
+static s64 ValidateUtf8AVX2(u8 *Data, s64 Count)
+{
+    s64 I = 0;
+    while(I + 32 <= Count)
+    {
+        u32 Mask = (u32)_mm256_movemask_epi8(_mm256_loadu_si256((__m256i *)(Data + I)));
+        if(Mask)
+        {
+            s32 Length;
+            I += __builtin_ctz(Mask);
+            Length = Utf8SequenceLength(Data + I, Count - I);
+            if(!Length)
+            {
+                return I;
+            }
+            I += Length;
+        }
+        else
+        {
+            I += 32;
+        }
+    }
+    return I + ValidateUtf8Scalar(Data + I, Count - I);
+}
+
+/* NOTE: byte compares into mask registers need AVX-512BW on top of AVX-512F */
+__attribute__((target("avx512f,avx512bw")))
+static s64 FindByteAVX512(u8 *Data, s64 Count, u8 Byte)
+{
+    __m512i Needle = _mm512_set1_epi8((char)Byte);
+    s64 I;
+    for(I = 0; I + 64 <= Count; I += 64)
+    {
+        u64 Mask = _mm512_cmpeq_epi8_mask(_mm512_loadu_si512((void *)(Data + I)), Needle);
+        if(Mask)
+        {
+            return I + __builtin_ctzll(Mask);
+        }
+    }
+    if(I < Count)
+    {
+        /* NOTE: masked-off bytes are not read, so the tail is one more block */
+        u64 Tail = ((u64)1 << (Count - I)) - 1;
+        u64 Mask = _mm512_mask_cmpeq_epi8_mask(Tail, _mm512_maskz_loadu_epi8(Tail, Data + I), Needle);
+        return Mask ? I + __builtin_ctzll(Mask) : Count;
+    }
+    return Count;
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static s64 FindFoldAVX512(u8 *Data, s64 Count)
+{
+    __m512i Newline = _mm512_set1_epi8('\n');
+    __m512i Space = _mm512_set1_epi8(' ');
+    __m512i Tab = _mm512_set1_epi8('\t');
+    s64 I;
+    for(I = 0; I + 65 <= Count; I += 64)
+    {
+        __m512i Block = _mm512_loadu_si512((void *)(Data + I));
+        __m512i Next = _mm512_loadu_si512((void *)(Data + I + 1));
+        u64 Mask = _mm512_cmpeq_epi8_mask(Block, Newline) &
+            (_mm512_cmpeq_epi8_mask(Next, Space) | _mm512_cmpeq_epi8_mask(Next, Tab));
+        if(Mask)
+        {
+            return I + __builtin_ctzll(Mask);
+        }
+    }
+    return I + FindFoldAVX2(Data + I, Count - I);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static s64 SkipPrintableAVX512(u8 *Data, s64 Count)
+{
+    __m512i Control = _mm512_set1_epi8(0x1F);
+    __m512i Delete = _mm512_set1_epi8(0x7F);
+    __m512i Tab = _mm512_set1_epi8('\t');
+    s64 I;
+    for(I = 0; I + 64 <= Count; I += 64)
+    {
+        __m512i Block = _mm512_loadu_si512((void *)(Data + I));
+        u64 Printable = (_mm512_cmpgt_epi8_mask(Block, Control) & _mm512_cmpneq_epi8_mask(Block, Delete)) |
+            _mm512_cmpeq_epi8_mask(Block, Tab);
+        if(~Printable)
+        {
+            return I + __builtin_ctzll(~Printable);
+        }
+    }
+    if(I < Count)
+    {
+        u64 Tail = ((u64)1 << (Count - I)) - 1;
+        __m512i Block = _mm512_maskz_loadu_epi8(Tail, Data + I);
+        u64 Printable = (_mm512_cmpgt_epi8_mask(Block, Control) & _mm512_cmpneq_epi8_mask(Block, Delete)) |
+            _mm512_cmpeq_epi8_mask(Block, Tab);
+        return (~Printable & Tail) ? I + __builtin_ctzll(~Printable & Tail) : Count;
+    }
+    return Count;
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static s64 ValidateUtf8AVX512(u8 *Data, s64 Count)
+{
+    s64 I = 0;
+    while(I + 64 <= Count)
+    {
+        u64 Mask = _mm512_movepi8_mask(_mm512_loadu_si512((void *)(Data + I)));
+        if(Mask)
+        {
+            s32 Length;
+            I += __builtin_ctzll(Mask);
+            Length = Utf8SequenceLength(Data + I, Count - I);
+            if(!Length)
+            {
+                return I;
+            }
+            I += Length;
+        }
+        else
+        {
+            I += 64;
+        }
+    }
+    return I + ValidateUtf8AVX2(Data + I, Count - I);
+}
+#endif
+
+/* NOTE: indexed by scan_level; levels this build has no code for are left empty */
+static scan_kernels SCAN_KERNELS[scan_level_Count] = {
+    {"scalar", FindByteScalar, FindFoldScalar, SkipPrintableScalar, ValidateUtf8Scalar},
+#if SCAN_KERNELS_X86
+    {"sse2", FindByteSSE2, FindFoldSSE2, SkipPrintableSSE2, ValidateUtf8SSE2},
+    {"avx2", FindByteAVX2, FindFoldAVX2, SkipPrintableAVX2, ValidateUtf8AVX2},
+    {"avx512", FindByteAVX512, FindFoldAVX512, SkipPrintableAVX512, ValidateUtf8AVX512},
+#endif
+};
+
+static scan_kernels ScanKernels = {"scalar", FindByteScalar, FindFoldScalar, SkipPrintableScalar, ValidateUtf8Scalar};
+static scan_level ScanLevel = scan_level_Scalar;
+
+#if SCAN_KERNELS_X86
+/* NOTE: the extended register state has to be enabled by the OS as well as the CPU */
+static u64 ReadXCR0(void)
+{
+    u32 Low, High;
+    __asm__ __volatile__("xgetbv" : "=a"(Low), "=d"(High) : "c"(0));
+    return ((u64)High << 32) | Low;
+}
+#endif
+
+/* NOTE: the highest level this CPU and OS can run */
+scan_level DetectScanLevel(void)
+{
+    scan_level Result = scan_level_Scalar;
+#if SCAN_KERNELS_X86
+    u32 Eax, Ebx, Ecx, Edx;
+    u64 XCR0;
+    /* NOTE: SSE2 is part of x86-64 */
+    Result = scan_level_SSE2;
+    if(!__get_cpuid(1, &Eax, &Ebx, &Ecx, &Edx) || !(Ecx & bit_OSXSAVE) || !(Ecx & bit_AVX))
+    {
+        return Result;
+    }
+    XCR0 = ReadXCR0();
+    /* NOTE: XMM and YMM state */
+    if((XCR0 & 0x6) != 0x6 || !__get_cpuid_count(7, 0, &Eax, &Ebx, &Ecx, &Edx))
+    {
+        return Result;
+    }
+    if(Ebx & bit_AVX2)
+    {
+        Result = scan_level_AVX2;
+        /* NOTE: opmask, upper ZMM0-15 and ZMM16-31 state */
+        if((Ebx & bit_AVX512F) && (Ebx & bit_AVX512BW) && (XCR0 & 0xE0) == 0xE0)
+        {
+            Result = scan_level_AVX512;
+        }
+    }
+#endif
+    return Result;
+}
+
+#if defined(__GNUC__)
+__attribute__((constructor))
+#endif
+void InitScanKernels(void)
+{
+    scan_level Level = DetectScanLevel();
+    char *Override = getenv("SCAN_KERNELS");
+    if(Override)
+    {
+        s32 I;
+        for(I = 0; I <= (s32)Level; ++I)
+        {
+            if(strcmp(Override, SCAN_KERNELS[I].Name) == 0)
+            {
+                Level = (scan_level)I;
+                break;
+            }
+        }
+    }
+    ScanLevel = Level;
+    ScanKernels = SCAN_KERNELS[Level];
+}
+
+#endif
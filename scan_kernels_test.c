@@ -0,0 +1,174 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "scan_kernels.h"
+
+#define TEST_MAX_COUNT 512
+#define TEST_ROUND_COUNT 20000
+
+/* NOTE: bytes the kernels care about, plus pieces of well-formed and broken UTF-8 */
+static u8 TEST_ALPHABET[] = {
+    'a', 'Z', '0', ':', ';', '"', ' ', ' ', '\t', '\n', '\n', '\r', 0x00, 0x1F, 0x7E, 0x7F,
+    0x80, 0xBF, 0xC2, 0xC3, 0xA9, 0xE0, 0xA0, 0xED, 0x9F, 0xF0, 0x90, 0xF4, 0x8F, 0xFF,
+};
+
+static u64 TestRandomState = 0x9E3779B97F4A7C15ULL;
+
+static u32 TestRandom(u32 Range)
+{
+    u64 X = TestRandomState;
+    X ^= X >> 12;
+    X ^= X << 25;
+    X ^= X >> 27;
+    TestRandomState = X;
+    return (u32)(((X * 0x2545F4914F6CDD1DULL) >> 32) % Range);
+}
+
+/* NOTE: mostly one kind of byte so the interesting ones land at every offset of a block */
+static void FillTestBytes(u8 *Data, s64 Count)
+{
+    u32 Mode = TestRandom(4);
+    s64 I;
+    for(I = 0; I < Count; ++I)
+    {
+        if(Mode == 0 || TestRandom(64) == 0)
+        {
+            Data[I] = TEST_ALPHABET[TestRandom(sizeof(TEST_ALPHABET))];
+        }
+        else if(Mode == 1)
+        {
+            Data[I] = (u8)TestRandom(256);
+        }
+        else
+        {
+            Data[I] = (u8)('a' + TestRandom(26));
+        }
+    }
+    if(Mode == 3 && Count >= 4)
+    {
+        /* NOTE: a well-formed multi-byte sequence somewhere in ASCII text */
+        static u8 Sequences[][4] = {{0xC3, 0xA9}, {0xE2, 0x82, 0xAC}, {0xF0, 0x9F, 0x98, 0x80}};
+        s32 Which = TestRandom(3);
+        memcpy(Data + TestRandom((u32)Count - 3), Sequences[Which], Which + 2);
+    }
+}
+
+static s32 CheckKernels(scan_level Level, u8 *Data, s64 Count)
+{
+    scan_kernels *Reference = &SCAN_KERNELS[scan_level_Scalar];
+    scan_kernels *Kernels = &SCAN_KERNELS[Level];
+    u8 Byte = TEST_ALPHABET[TestRandom(sizeof(TEST_ALPHABET))];
+    s64 Expected, Actual;
+    char *Kernel = 0;
+    if((Expected = Reference->FindByte(Data, Count, Byte)) != (Actual = Kernels->FindByte(Data, Count, Byte)))
+    {
+        Kernel = "FindByte";
+    }
+    else if((Expected = Reference->FindFold(Data, Count)) != (Actual = Kernels->FindFold(Data, Count)))
+    {
+        Kernel = "FindFold";
+    }
+    else if((Expected = Reference->SkipPrintable(Data, Count)) != (Actual = Kernels->SkipPrintable(Data, Count)))
+    {
+        Kernel = "SkipPrintable";
+    }
+    else if((Expected = Reference->ValidateUtf8(Data, Count)) != (Actual = Kernels->ValidateUtf8(Data, Count)))
+    {
+        Kernel = "ValidateUtf8";
+    }
+    if(Kernel)
+    {
+        printf("%s %s on %ld bytes: %ld, expected %ld\n", Kernels->Name, Kernel, (long)Count,
+               (long)Actual, (long)Expected);
+        return 0;
+    }
+    return 1;
+}
+
+static s32 TestUtf8SequenceLength(void)
+{
+    static struct
+    {
+        u8 Bytes[4];
+        s32 Count;
+        s32 Expected;
+    } Cases[] = {
+        {{'a'}, 1, 1},
+        {{0xC3, 0xA9}, 2, 2},
+        {{0xE2, 0x82, 0xAC}, 3, 3},
+        {{0xF0, 0x9F, 0x98, 0x80}, 4, 4},
+        {{0xF4, 0x8F, 0xBF, 0xBF}, 4, 4},
+        {{0x80}, 1, 0},
+        {{0xC0, 0x80}, 2, 0},
+        {{0xC3, 0x28}, 2, 0},
+        {{0xE0, 0x80, 0x80}, 3, 0},
+        {{0xED, 0xA0, 0x80}, 3, 0},
+        {{0xE2, 0x82}, 2, 0},
+        {{0xF4, 0x90, 0x80, 0x80}, 4, 0},
+        {{0xF5, 0x80, 0x80, 0x80}, 4, 0},
+    };
+    s32 I, Ok = 1;
+    for(I = 0; I < (s32)(sizeof(Cases) / sizeof(Cases[0])); ++I)
+    {
+        s32 Length = Utf8SequenceLength(Cases[I].Bytes, Cases[I].Count);
+        if(Length != Cases[I].Expected)
+        {
+            printf("Utf8SequenceLength case %d: %d, expected %d\n", I, Length, Cases[I].Expected);
+            Ok = 0;
+        }
+    }
+    printf("TestUtf8SequenceLength %s\n", Ok ? "passed" : "FAILED");
+    return Ok;
+}
+
+/*
+  Every variant the CPU can run must agree with the scalar reference. The inputs end right
+  before an inaccessible page, so a kernel that reads past Count crashes the test.
+*/
+static s32 TestScanKernels(scan_level Level)
+{
+    s64 PageSize = sysconf(_SC_PAGESIZE);
+    s64 MapSize = 2 * PageSize + TEST_MAX_COUNT;
+    u8 *Map = mmap(0, MapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    u8 *Guard;
+    s32 Round, Ok = 1;
+    if(Map == MAP_FAILED)
+    {
+        printf("TestScanKernels: mmap failed\n");
+        return 0;
+    }
+    Guard = Map + ((TEST_MAX_COUNT + PageSize - 1) / PageSize) * PageSize;
+    mprotect(Guard, PageSize, PROT_NONE);
+    for(Round = 0; Ok && Round < TEST_ROUND_COUNT; ++Round)
+    {
+        s64 Count = TestRandom(TEST_MAX_COUNT + 1);
+        u8 *Data = Guard - Count;
+        FillTestBytes(Data, Count);
+        Ok = CheckKernels(Level, Data, Count);
+    }
+    munmap(Map, MapSize);
+    printf("TestScanKernels %s %s\n", SCAN_KERNELS[Level].Name, Ok ? "passed" : "FAILED");
+    return Ok;
+}
+
+int main(void)
+{
+    scan_level Detected = DetectScanLevel();
+    s32 Level, Ok = TestUtf8SequenceLength();
+    printf("Detected %s, bound %s\n", SCAN_KERNELS[Detected].Name, ScanKernels.Name);
+    for(Level = scan_level_Scalar + 1; Level < scan_level_Count; ++Level)
+    {
+        if(!SCAN_KERNELS[Level].Name)
+        {
+            continue;
+        }
+        if(Level > (s32)Detected)
+        {
+            printf("TestScanKernels %s skipped, not supported here\n", SCAN_KERNELS[Level].Name);
+            continue;
+        }
+        Ok &= TestScanKernels((scan_level)Level);
+    }
+    return !Ok;
+}